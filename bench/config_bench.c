@@ -0,0 +1,379 @@
+/*
+ * config_bench.c ~ Loading, lookups and freeing of generated configs.
+ *
+ * Built and run by "make bench" as bench/config_bench, with the table
+ * and hash function picked by HASH=chain|open and HASHFN=WORD|FNV1A|DJB2.
+ * For every number of keys it generates a config and prints one line:
+ *
+ *   keys=100000 bytes=... load_ms=... load_mbs=... load_keys_s=...
+ *   hit_p50_ns=... hit_p99_ns=... miss_p50_ns=... miss_p99_ns=...
+ *   find_p50_ns=... find_p99_ns=... free_ms=... peak_rss_kb=... timer_ns=...
+ *
+ * Options are a mix of plain values, quoted strings and small arrays,
+ * with keys from a few characters to over a hundred long, plus a few
+ * arrays of BIG_ELEMS elements that cConfig_find_opt_value searches.
+ * Every size runs in a child process so peak_rss_kb is its own. The
+ * config is loaded with cConfig_load_mmap, cConfig_load only reads
+ * lines of up to 254 characters. The latencies are of single
+ * cConfig_get_value and cConfig_find_opt_value calls and include
+ * reading the clock once, which costs timer_ns.
+ *
+ * Usage: config_bench [KEYS...], defaults to 1000 10000 100000 1000000.
+ *        config_bench -g KEYS writes the config for KEYS to stdout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "cConfig.h"
+
+#define TMP_FILE "/tmp/cConfig_bench.conf"
+
+/* Number of calls timed per kind of lookup, whatever the size. */
+#define SAMPLES 200000
+
+/* Elements of each array cConfig_find_opt_value searches. */
+#define BIG_ELEMS 4096
+
+static uint64_t
+mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+
+    return x;
+}
+
+static uint64_t
+next_rand(uint64_t *x)
+{
+    *x ^= *x << 13;
+    *x ^= *x >> 7;
+    *x ^= *x << 17;
+
+    return *x;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Name of option I. Most keys are short or dotted, some are long. */
+static int
+make_key(char *buf, size_t size, size_t i)
+{
+    uint64_t h = mix(i + 1);
+
+    switch (h % 8)
+    {
+    case 0:
+    case 1:
+    case 2:
+        return snprintf(buf, size, "k%zu", i);
+    case 3:
+    case 4:
+    case 5:
+        return snprintf(buf, size, "svc.%zu.option_%u", i, (unsigned int)(h >> 8) % 16);
+    case 6:
+        return snprintf(buf, size, "region.%u.cluster.%u.service_%zu.connection_timeout",
+                        (unsigned int)(h >> 8) % 32, (unsigned int)(h >> 16) % 64, i);
+    default:
+        return snprintf(buf, size, "platform.infrastructure.networking.load_balancers."
+                        "frontend_%zu.listeners.https.tls.certificate_chain_path", i);
+    }
+}
+
+/* What option I holds: 0 to 6 a plain value, 7 and 8 a quoted
+   string and 9 an array. */
+static unsigned int
+option_kind(size_t i)
+{
+    return (mix(i + 1) >> 24) % 10;
+}
+
+static size_t
+big_arrays(size_t keys)
+{
+    size_t n = keys / 1000;
+
+    return n < 1 ? 1 : n > 8 ? 8 : n;
+}
+
+/* Write a config of KEYS options, and the big arrays, to F. */
+static void
+generate(FILE *f, size_t keys)
+{
+    char key[256];
+    size_t i, j, n;
+    uint64_t h;
+
+    for (i = 0; i < keys; ++i)
+    {
+        make_key(key, sizeof(key), i);
+        h = mix(i + 1) >> 32;
+
+        switch (option_kind(i))
+        {
+        case 7:
+        case 8:
+            fprintf(f, "%s = \"quoted value with spaces for option %zu\"\n", key, i);
+            break;
+        case 9:
+            fprintf(f, "%s = (", key);
+
+            for (j = 0, n = 1 + (h >> 8) % 8; j < n; ++j)
+                fprintf(f, "%selem_%zu", j ? ", " : "", j);
+
+            fprintf(f, ")\n");
+            break;
+        default:
+            fprintf(f, "%s = value_%zu\n", key, i);
+            break;
+        }
+    }
+
+    for (i = 0; i < big_arrays(keys); ++i)
+    {
+        fprintf(f, "big.%zu = (", i);
+
+        for (j = 0; j < BIG_ELEMS; ++j)
+            fprintf(f, "%se%zu", j ? ", " : "", j);
+
+        fprintf(f, ")\n");
+    }
+}
+
+static int
+compare_ns(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static double
+percentile(double *samples, size_t n, double p)
+{
+    return samples[(size_t)(p * (n - 1))];
+}
+
+/* Time SAMPLES cConfig_get_value calls, of keys that are in the
+   config if HIT is non zero. Arrays don't have a value, so hits are of
+   the other options. P50 and P99 are in nanoseconds. */
+static void
+time_get(cConfig_ctx *ctx, size_t keys, unsigned int hit, double *samples,
+         double *p50, double *p99)
+{
+    char key[256];
+    size_t i, n, len;
+    uint64_t x = 88172645463325252ULL;
+    double start;
+
+    for (i = 0; i < SAMPLES; ++i)
+    {
+        while (option_kind(n = next_rand(&x) % keys) == 9 && hit)
+            ;
+
+        len = hit ? 0 : (size_t)snprintf(key, sizeof(key), "miss.");
+        make_key(key + len, sizeof(key) - len, n);
+
+        start = now();
+
+        if ((cConfig_ctx_get_value(ctx, key) != NULL) != hit)
+        {
+            fprintf(stderr, "keys=%zu lookup of %s went wrong\n", keys, key);
+            exit(1);
+        }
+
+        samples[i] = now() - start;
+    }
+
+    qsort(samples, SAMPLES, sizeof(double), compare_ns);
+
+    *p50 = percentile(samples, SAMPLES, 0.50);
+    *p99 = percentile(samples, SAMPLES, 0.99);
+}
+
+/* Time SAMPLES cConfig_find_opt_value calls on the big arrays, after
+   one call on each has built its index. */
+static void
+time_find(cConfig_ctx *ctx, size_t keys, double *samples, double *p50, double *p99)
+{
+    char name[32], value[32];
+    size_t i, n;
+    uint64_t x = 2463534242ULL;
+    double start;
+
+    n = big_arrays(keys);
+
+    for (i = 0; i < n; ++i)
+    {
+        snprintf(name, sizeof(name), "big.%zu", i);
+        cConfig_ctx_find_opt_value(ctx, name, "e0");
+    }
+
+    for (i = 0; i < SAMPLES; ++i)
+    {
+        snprintf(name, sizeof(name), "big.%zu", (size_t)(next_rand(&x) % n));
+        snprintf(value, sizeof(value), "e%zu", (size_t)(next_rand(&x) % BIG_ELEMS));
+
+        start = now();
+
+        if (!cConfig_ctx_find_opt_value(ctx, name, value))
+        {
+            fprintf(stderr, "keys=%zu %s not found in %s\n", keys, value, name);
+            exit(1);
+        }
+
+        samples[i] = now() - start;
+    }
+
+    qsort(samples, SAMPLES, sizeof(double), compare_ns);
+
+    *p50 = percentile(samples, SAMPLES, 0.50);
+    *p99 = percentile(samples, SAMPLES, 0.99);
+}
+
+/* Cost of the clock reads around every timed call. */
+static double
+timer_cost(void)
+{
+    double start, t = 0;
+    size_t i;
+
+    start = now();
+
+    for (i = 0; i < SAMPLES; ++i)
+        t += now();
+
+    /* Keep the loop from being optimized away. */
+    if (t < 0)
+        puts("");
+
+    return (now() - start) / SAMPLES;
+}
+
+/* Measure KEYS options of the config in TMP_FILE, BYTES long. Runs in
+   a child of its own. */
+static void
+measure(size_t keys, size_t bytes)
+{
+    cConfig_ctx *ctx;
+    struct rusage usage;
+    double *samples, start, load, free_ms;
+    double hit50, hit99, miss50, miss99, find50, find99;
+
+    samples = malloc(SAMPLES * sizeof(double));
+
+    if (samples == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    ctx = cConfig_ctx_new();
+
+    start = now();
+
+    if (!cConfig_ctx_load_mmap(ctx, TMP_FILE))
+    {
+        fprintf(stderr, "keys=%zu load failed\n", keys);
+        exit(1);
+    }
+
+    load = now() - start;
+
+    time_get(ctx, keys, 1, samples, &hit50, &hit99);
+    time_get(ctx, keys, 0, samples, &miss50, &miss99);
+    time_find(ctx, keys, samples, &find50, &find99);
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    start = now();
+    cConfig_ctx_free(ctx);
+    free_ms = (now() - start) / 1e6;
+
+    printf("keys=%zu bytes=%zu load_ms=%.2f load_mbs=%.1f load_keys_s=%.0f "
+           "hit_p50_ns=%.0f hit_p99_ns=%.0f miss_p50_ns=%.0f miss_p99_ns=%.0f "
+           "find_p50_ns=%.0f find_p99_ns=%.0f free_ms=%.2f peak_rss_kb=%ld timer_ns=%.0f\n",
+           keys, bytes, load / 1e6, bytes / (load / 1e9) / (1024 * 1024), keys / (load / 1e9),
+           hit50, hit99, miss50, miss99, find50, find99, free_ms, usage.ru_maxrss, timer_cost());
+
+    free(samples);
+}
+
+static void
+bench(size_t keys)
+{
+    struct stat st;
+    FILE *f;
+    pid_t pid;
+    int status;
+
+    if ((f = fopen(TMP_FILE, "w")) == NULL)
+    {
+        perror(TMP_FILE);
+        exit(1);
+    }
+
+    generate(f, keys);
+
+    if (fclose(f) != 0 || stat(TMP_FILE, &st) == -1)
+    {
+        perror(TMP_FILE);
+        exit(1);
+    }
+
+    fflush(stdout);
+
+    if ((pid = fork()) == 0)
+    {
+        measure(keys, st.st_size);
+        fflush(stdout);
+        _exit(0);
+    }
+
+    if (pid == -1 || waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status))
+        fprintf(stderr, "keys=%zu failed\n", keys);
+
+    unlink(TMP_FILE);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int i;
+
+    if (argc == 3 && strcmp(argv[1], "-g") == 0)
+    {
+        generate(stdout, strtoul(argv[2], NULL, 10));
+        return 0;
+    }
+
+    if (argc < 2)
+    {
+        bench(1000);
+        bench(10000);
+        bench(100000);
+        bench(1000000);
+        return 0;
+    }
+
+    for (i = 1; i < argc; ++i)
+        bench(strtoul(argv[i], NULL, 10));
+
+    return 0;
+}
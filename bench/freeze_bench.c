@@ -0,0 +1,160 @@
+/*
+ * freeze_bench.c ~ Lookups before and after cConfig_freeze.
+ *
+ * Built by "make freeze-bench" as bench/freeze_bench, with the chained
+ * table and the hash function picked by HASHFN=WORD|FNV1A|DJB2. For
+ * every number of keys it loads a generated config and prints:
+ *
+ *   keys=100000 freeze_ms=... table_hit_ns=... table_miss_ns=...
+ *   frozen_hit_ns=... frozen_miss_ns=... speedup_hit=... speedup_miss=...
+ *
+ * on one line. Lookups go through cConfig_ctx_get_opt, so they include
+ * hashing the name and entering and leaving the read side.
+ *
+ * Usage: freeze_bench [KEYS...], defaults to 1000 100000 1000000.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lib.h"
+#include "cConfig.h"
+
+#define TMP_FILE "/tmp/cConfig_freeze_bench.conf"
+
+/* Number of lookups timed per table, whatever its size. */
+#define LOOKUPS 2000000
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Keys look like the ones in a generated config, "svc.<n>.option". */
+static char **
+make_keys(Arena *arena, size_t n, const char *prefix)
+{
+    char buf[64], **keys;
+    size_t i, len;
+
+    keys = xmalloc(n * sizeof(char *));
+
+    for (i = 0; i < n; ++i)
+    {
+        len = snprintf(buf, sizeof(buf), "%s.%zu.option", prefix, i * 2654435761u % n);
+        keys[i] = arena_dupstrn(arena, buf, len);
+    }
+
+    return keys;
+}
+
+/* Time LOOKUPS lookups of KEYS in a random order. */
+static double
+time_lookups(cConfig_ctx *ctx, char **keys, size_t n, size_t *found)
+{
+    double start;
+    size_t i, x;
+
+    *found = 0;
+    x = 88172645463325252u & 0xffffffffu;
+
+    start = now();
+
+    for (i = 0; i < LOOKUPS; ++i)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+
+        if (cConfig_ctx_get_opt(ctx, keys[x % n]))
+            (*found)++;
+    }
+
+    return (now() - start) / LOOKUPS;
+}
+
+static void
+bench(size_t n)
+{
+    Arena *arena;
+    cConfig_ctx *ctx;
+    char **hits, **misses;
+    double start, freeze, table_hit, table_miss, hit, miss;
+    size_t i, found;
+    FILE *f;
+
+    arena = new_arena(1 << 20);
+
+    hits = make_keys(arena, n, "svc");
+    misses = make_keys(arena, n, "nosvc");
+
+    if ((f = fopen(TMP_FILE, "w")) == NULL)
+    {
+        perror(TMP_FILE);
+        exit(1);
+    }
+
+    for (i = 0; i < n; ++i)
+        fprintf(f, "%s = value_%zu\n", hits[i], i);
+
+    fclose(f);
+
+    ctx = cConfig_ctx_new();
+    cConfig_ctx_load_mmap(ctx, TMP_FILE);
+    unlink(TMP_FILE);
+
+    table_hit = time_lookups(ctx, hits, n, &found);
+    table_miss = time_lookups(ctx, misses, n, &found);
+
+    start = now();
+
+    if (!cConfig_ctx_freeze(ctx))
+    {
+        fprintf(stderr, "keys=%zu freeze failed\n", n);
+        exit(1);
+    }
+
+    freeze = (now() - start) / 1e6;
+
+    hit = time_lookups(ctx, hits, n, &found);
+
+    if (found != LOOKUPS)
+        fprintf(stderr, "keys=%zu frozen table lost keys\n", n);
+
+    miss = time_lookups(ctx, misses, n, &found);
+
+    printf("keys=%zu freeze_ms=%.2f table_hit_ns=%.1f table_miss_ns=%.1f "
+           "frozen_hit_ns=%.1f frozen_miss_ns=%.1f speedup_hit=%.2f speedup_miss=%.2f\n",
+           n, freeze, table_hit, table_miss, hit, miss, table_hit / hit, table_miss / miss);
+
+    cConfig_ctx_free(ctx);
+    xfree(hits);
+    xfree(misses);
+    free_arena(arena);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int i;
+
+    if (argc < 2)
+    {
+        bench(1000);
+        bench(100000);
+        bench(1000000);
+        return 0;
+    }
+
+    for (i = 1; i < argc; ++i)
+        bench(strtoul(argv[i], NULL, 10));
+
+    return 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * hash_bench.c ~ Lookup latency of the hash table engine it is built with.
+ *
+ * Built once per engine by "make hash-bench", as bench/hash_chain and
+ * bench/hash_open, with the hash function picked by HASHFN=WORD|FNV1A|DJB2.
+ * Every run prints one line per table size:
+ *
+ *   engine=open hash=WORD keys=100000 insert_ns=... hit_ns=... miss_ns=...
+ *
+ * Usage: hash_chain [KEYS...], defaults to 1000 100000 10000000.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "lib.h"
+#include "hash.h"
+
+#ifdef CCONFIG_OPEN_HASH
+#define ENGINE "open"
+#else
+#define ENGINE "chain"
+#endif
+
+#if CCONFIG_HASH_FN == HASH_FN_WORD
+#define HASH_FN "WORD"
+#elif CCONFIG_HASH_FN == HASH_FN_FNV1A
+#define HASH_FN "FNV1A"
+#else
+#define HASH_FN "DJB2"
+#endif
+
+/* Number of lookups timed per table, whatever its size. */
+#define LOOKUPS 2000000
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Keys look like the ones in a generated config, "svc.<n>.option". */
+static char **
+make_keys(Arena *arena, size_t n, const char *prefix)
+{
+    char buf[64], **keys;
+    size_t i, len;
+
+    keys = xmalloc(n * sizeof(char *));
+
+    for (i = 0; i < n; ++i)
+    {
+        len = snprintf(buf, sizeof(buf), "%s.%zu.option", prefix, i * 2654435761u % n);
+        keys[i] = arena_dupstrn(arena, buf, len);
+    }
+
+    return keys;
+}
+
+/* Time LOOKUPS lookups of KEYS in a random order. */
+static double
+time_lookups(Hash_table *table, char **keys, size_t n, size_t *found)
+{
+    double start;
+    size_t i, x;
+
+    *found = 0;
+    x = 88172645463325252u & 0xffffffffu;
+
+    start = now();
+
+    for (i = 0; i < LOOKUPS; ++i)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+
+        if (find_hash_node(keys[x % n], table))
+            (*found)++;
+    }
+
+    return (now() - start) / LOOKUPS;
+}
+
+static void
+bench(size_t n)
+{
+    Arena *arena;
+    Hash_table *table;
+    char **hits, **misses;
+    double start, insert, hit, miss;
+    size_t i, found_hit, found_miss;
+
+    arena = new_arena(1 << 20);
+
+    hits = make_keys(arena, n, "svc");
+    misses = make_keys(arena, n, "nosvc");
+
+    /* Start small, growing is part of the insert cost. */
+    table = new_hash_table(8);
+    table->arena = arena;
+
+    start = now();
+
+    for (i = 0; i < n; ++i)
+        insert_hash_node(hits[i], hits[i], table);
+
+    insert = (now() - start) / n;
+
+    hit = time_lookups(table, hits, n, &found_hit);
+    miss = time_lookups(table, misses, n, &found_miss);
+
+    printf("engine=%s hash=%s keys=%zu insert_ns=%.1f hit_ns=%.1f miss_ns=%.1f found=%zu/%zu\n",
+           ENGINE, HASH_FN, n, insert, hit, miss, found_hit, found_miss);
+
+    free_hash_table(table);
+    xfree(hits);
+    xfree(misses);
+    free_arena(arena);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int i;
+
+    if (argc < 2)
+    {
+        bench(1000);
+        bench(100000);
+        bench(10000000);
+        return 0;
+    }
+
+    for (i = 1; i < argc; ++i)
+        bench(strtoul(argv[i], NULL, 10));
+
+    return 0;
+}
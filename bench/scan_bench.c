@@ -0,0 +1,217 @@
+/*
+ * scan_bench.c ~ Throughput of the line scanner used by parse_line.
+ *
+ * Built by "make scan-bench" as bench/scan_bench. For every input and
+ * every scan_line version the CPU supports it prints one line:
+ *
+ *   input=realistic impl=avx2 mb=64.0 scan_mbs=... load_mbs=...
+ *
+ * scan_mbs is the version on its own, stepping from one character that
+ * needs a look to the next. load_mbs is cConfig_load_mmap using it, run
+ * in a child process with CCONFIG_SCAN set so "scalar" is the speed of
+ * the byte at a time parser.
+ *
+ * Usage: scan_bench [MB], defaults to 64.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "scan.h"
+#include "cConfig.h"
+
+#define TMP_FILE "/tmp/cConfig_scan_bench.conf"
+
+typedef const char *(*scan_fn)(const char *, const char *, char);
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Options like the ones in a generated config, with some quoted
+   values, arrays and comments. */
+static size_t
+make_realistic(char *buf, size_t size)
+{
+    size_t len = 0, i = 0;
+
+    while (len + 256 < size)
+    {
+        switch (i % 8)
+        {
+        case 0:
+            len += sprintf(buf + len, "# settings for service %zu\n", i);
+            break;
+        case 1:
+            len += sprintf(buf + len, "svc.%zu.description = \"frontend for region %zu\"\n", i, i % 17);
+            break;
+        case 2:
+            len += sprintf(buf + len, "svc.%zu.hosts = (host-a.example.com, host-b.example.com)\n", i);
+            break;
+        default:
+            len += sprintf(buf + len, "svc.%zu.option_%zu = value_%zu_abcdefgh\n", i, i % 8, i);
+            break;
+        }
+
+        i++;
+    }
+
+    return len;
+}
+
+/* Nothing but short tokens, every other character needs a look. */
+static size_t
+make_dense(char *buf, size_t size)
+{
+    size_t len = 0, i = 0;
+
+    while (len + 64 < size)
+        len += sprintf(buf + len, "k%zu = (a, b, c, d, e, f, g)\n", i++);
+
+    return len;
+}
+
+/* Long quoted values without a single character that needs a look. */
+static size_t
+make_long(char *buf, size_t size)
+{
+    size_t len = 0, i = 0, n;
+
+    while (len + 4200 < size)
+    {
+        len += sprintf(buf + len, "blob%zu = \"", i++);
+
+        for (n = 0; n < 4000; ++n)
+            buf[len++] = 'a' + n % 26;
+
+        len += sprintf(buf + len, "\"\n");
+    }
+
+    return len;
+}
+
+static double
+time_scan(scan_fn fn, const char *buf, size_t len)
+{
+    const char *string, *end;
+    double start;
+    size_t stops = 0;
+
+    end = buf + len;
+    start = now();
+
+    for (string = buf; (string = fn(string, end, '=')) < end; ++string)
+        stops++;
+
+    /* Keep the loop from being optimized away. */
+    if (stops == (size_t)-1)
+        puts("");
+
+    return len / ((now() - start) / 1e9) / (1024 * 1024);
+}
+
+/* Time cConfig_load_mmap of TMP_FILE in a child that uses IMPL. */
+static double
+time_load(const char *impl, size_t len)
+{
+    int fds[2], status;
+    double start, mbs = 0;
+    cConfig_ctx *ctx;
+    pid_t pid;
+
+    if (pipe(fds) == -1)
+        return 0;
+
+    if ((pid = fork()) == 0)
+    {
+        close(fds[0]);
+        setenv("CCONFIG_SCAN", impl, 1);
+
+        ctx = cConfig_ctx_new();
+
+        start = now();
+        cConfig_ctx_load_mmap(ctx, TMP_FILE);
+        mbs = len / ((now() - start) / 1e9) / (1024 * 1024);
+
+        if (write(fds[1], &mbs, sizeof(mbs)) != sizeof(mbs))
+            _exit(1);
+
+        _exit(0);
+    }
+
+    close(fds[1]);
+
+    if (pid > 0)
+    {
+        if (read(fds[0], &mbs, sizeof(mbs)) != sizeof(mbs))
+            mbs = 0;
+
+        waitpid(pid, &status, 0);
+    }
+
+    close(fds[0]);
+
+    return mbs;
+}
+
+static void
+bench(const char *input, char *buf, size_t len)
+{
+    FILE *f;
+
+    if ((f = fopen(TMP_FILE, "w")) == NULL || fwrite(buf, 1, len, f) != len)
+    {
+        perror(TMP_FILE);
+        exit(1);
+    }
+
+    fclose(f);
+
+    printf("input=%s impl=scalar mb=%.1f scan_mbs=%.0f load_mbs=%.0f\n", input,
+           len / 1048576.0, time_scan(scan_line_scalar, buf, len), time_load("scalar", len));
+
+#ifdef CCONFIG_SCAN_X86
+    printf("input=%s impl=sse2 mb=%.1f scan_mbs=%.0f load_mbs=%.0f\n", input,
+           len / 1048576.0, time_scan(scan_line_sse2, buf, len), time_load("sse2", len));
+
+    if (scan_have_avx2())
+        printf("input=%s impl=avx2 mb=%.1f scan_mbs=%.0f load_mbs=%.0f\n", input,
+               len / 1048576.0, time_scan(scan_line_avx2, buf, len), time_load("avx2", len));
+#endif
+
+    unlink(TMP_FILE);
+}
+
+int
+main(int argc, char *argv[])
+{
+    size_t size;
+    char *buf;
+
+    size = (argc > 1 ? strtoul(argv[1], NULL, 10) : 64) * 1024 * 1024;
+    buf = malloc(size);
+
+    if (buf == NULL)
+    {
+        perror("malloc");
+        return 1;
+    }
+
+    bench("realistic", buf, make_realistic(buf, size));
+    bench("dense", buf, make_dense(buf, size));
+    bench("long", buf, make_long(buf, size));
+
+    free(buf);
+
+    return 0;
+}
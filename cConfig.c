@@ -27,25 +27,393 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "hash.h"
 #include "lib.h"
+#include "epoch.h"
+#include "scan.h"
+#include "profile.h"
 #include "cConfig.h"
 
 #define TABLE_SIZE 150
+#define ARENA_SIZE 4096
+
+/* Fewest keys a resolved array, and the slots keys are found by name
+   through, have room for. */
+#define RESOLVED_MIN 16
+
+/* Arrays of at least INDEX_SORTED_MIN elements are searched through a
+   sorted copy, from INDEX_HASHED_MIN on through a hash set. */
+#define INDEX_SORTED_MIN 16
+#define INDEX_HASHED_MIN 1024
+
+/* Size cConfig_parse_stream reads in, it grows for longer lines. */
+#define STREAM_BUF_SIZE (64 * 1024)
+
+/* Smallest part of a file load_parallel gives a thread of its own. */
+#define PARALLEL_MIN_CHUNK (64 * 1024)
+
+/* A watched table starts a new arena for its options once those that
+   changed take more memory than those in use, and at least this much. */
+#define WATCH_COMPACT_MIN (64 * 1024)
+
+/* Identifies a snapshot written by cConfig_compile. The version goes up
+   whenever the layout changes, older snapshots are then ignored. */
+#define SNAPSHOT_MAGIC      "cCfgSnp"
+#define SNAPSHOT_VERSION    2
+#define SNAPSHOT_BYTE_ORDER 0x01020304
+
+/* States of an option in a snapshot, see snapshot_opt. */
+#define RELOC_RAW  0
+#define RELOC_BUSY 1
+#define RELOC_DONE 2
+
+#define RELOCATE(s, p) ((void *)((s)->base + (uintptr_t)(p)))
+
+/* Magic of the segment cConfig_publish_shm names after the table, and
+   how often cConfig_attach_shm reads the generation again if its
+   segment was just replaced. */
+#define SHM_MAGIC        "cCfgShm"
+#define SHM_ATTACH_TRIES 16
+
+/* cConfig_freeze puts about FROZEN_BUCKET_KEYS options in a bucket. A
+   seed with FROZEN_DIRECT set is the slot of the only option in its
+   bucket, others are tried up to FROZEN_MAX_SEED. */
+#define FROZEN_BUCKET_KEYS 2
+#define FROZEN_DIRECT      0x80000000u
+#define FROZEN_MAX_SEED    (1u << 24)
+
+/* Maps the 32 bit X onto [0, N) without a division. */
+#define FROZEN_RANGE(x, n) ((size_t)(((uint64_t)(uint32_t)(x) * (n)) >> 32))
 
 #define DQUOTE       '"'
 #define PAREN_OPEN   '('
 #define PAREN_CLOSE  ')'
 
 #define END_LINE(c) (c == '\n' || c == '\0')
+#define AT_END(s, end) ((s) == (end) || END_LINE(*(s)))
+
+/* Marks the typed cache of an option while one thread fills it in. */
+#define CACHE_BUSY ((unsigned int)-1)
+
+/* Lookups by name are counted for cConfig_get_stats in builds with
+   STATS=1 only. */
+#ifdef CCONFIG_STATS
+#define COUNT_LOOKUP(opt) epoch_count_lookup((opt) != NULL)
+#else
+#define COUNT_LOOKUP(opt)
+#endif
+
+/* Files mapped by cConfig_load_mmap, options point into them. */
+struct mapping
+{
+    void *addr;
+    size_t len;
+    struct mapping *next;
+};
+
+/* The tokens parse_line found on a single line. */
+struct line
+{
+    char *name;
+    size_t name_len;
+    char *value;
+    size_t value_len;
+    unsigned int is_array;
+};
+
+/* The names cConfig_load_filtered keeps, the options of lines with
+   a name that doesn't start with one of PREFIXES are skipped. */
+struct filter
+{
+    const char **prefixes;
+    size_t *lens;
+    size_t count;
+};
+
+/* A key returned by cConfig_resolve. INDEX is its slot in the arrays
+   of resolved options the versions of CTX keep. */
+struct cConfig_key
+{
+    char *name;
+    uint64_t hash;
+    size_t index;
+    cConfig_ctx *ctx;
+};
+
+/* The option every key resolved to in a version, by key index. Only
+   valid while the version is still at GENERATION. Keys resolved later
+   are added in place while there is room for SIZE of them, and an
+   option added to the version updates the keys of its name, so only
+   loads make a new array. */
+struct resolved
+{
+    unsigned long generation;
+    size_t count;
+    size_t size;
+
+    /* Epoch the array was replaced in, and the next replaced array
+       waiting to be freed. */
+    unsigned long retired;
+    struct resolved *next;
+
+    cConfig_opt *opts[];
+};
+
+/* Start of a snapshot. Everything in it is found through offsets from
+   the start of the file, so it can be mapped anywhere. */
+struct snapshot_header
+{
+    char magic[8];
+    uint32_t version;
+
+    /* What the snapshot can only be used with. */
+    uint32_t byte_order;
+    uint32_t ptr_size;
+    uint32_t opt_size;
+    uint32_t hash_fn;
+    uint32_t unused;
+
+    /* Size of the whole snapshot. */
+    uint64_t size;
+
+    /* The options: COUNT cConfig_opt records at OPTS with offsets in
+       place of pointers, a RELOC_ state per option at STATES, and a
+       hash index of SLOT_COUNT slots at SLOTS. ELEMS is the number of
+       elements of the options that are arrays. */
+    uint64_t count;
+    uint64_t elems;
+    uint64_t opts;
+    uint64_t states;
+    uint64_t slots;
+    uint64_t slot_count;
+
+    /* The text file the snapshot was compiled from. */
+    uint64_t src_size;
+    int64_t src_mtime_sec;
+    int64_t src_mtime_nsec;
+    uint64_t src_hash;
+
+    /* hash_string of everything past the header, and of the header up
+       to HEADER_CHECKSUM. */
+    uint64_t checksum;
+    uint64_t header_checksum;
+};
+
+/* A slot of the hash index of a snapshot, open addressing with linear
+   probing. The name is kept here so a lookup doesn't have to read an
+   option another thread might be relocating. */
+struct snapshot_slot
+{
+    uint64_t hash;
+    uint64_t name;
+
+    /* Number of the option plus one, 0 if the slot is empty. */
+    uint64_t opt;
+};
+
+/* A snapshot mapped by cConfig_load_snapshot. */
+struct snapshot
+{
+    char *base;
+    cConfig_opt *opts;
+    uint32_t *states;
+    struct snapshot_slot *slots;
+    size_t mask;
+    size_t count;
+
+    /* The mapped file, see cConfig_attach_shm. */
+    dev_t dev;
+    ino_t ino;
+};
+
+/* A slot of the index of a file loaded by cConfig_load_lazy. */
+struct lazy_slot
+{
+    /* Offset of the name in the file plus one, 0 if the slot is
+       empty. The name is LEN bytes, spaces in it included. */
+    uint64_t name;
+    uint32_t len;
+
+    /* High bits of the hash of the name. */
+    uint32_t hash;
+};
+
+/* A file loaded by cConfig_load_lazy. Only where the options are is
+   known, each one is parsed the first time it is looked up. */
+struct lazy
+{
+    const char *base;
+    const char *end;
+    char delim;
+
+    /* Open addressing with linear probing, MASK + 1 slots. */
+    struct lazy_slot *slots;
+    size_t mask;
+
+    /* The options parsed so far by slot, only set with the lock of
+       the version held. Pages of it that are never written aren't allocated. */
+    cConfig_opt **opts;
+};
+
+/* A table made by cConfig_freeze, a minimal perfect hash over every
+   option (hash and displace): an option's bucket picks a seed, which
+   together with its hash gives the one slot it can be in. */
+struct frozen
+{
+    /* Number of options and slots, and of buckets. */
+    size_t count;
+    size_t buckets;
+
+    /* The seed of every bucket. */
+    uint32_t *seeds;
+
+    /* Every slot holds the hash_key of its option and a copy of the
+       option itself. */
+    uint64_t *hashes;
+    cConfig_opt *opts;
+};
+
+/* Everything loaded into the table. cConfig_reload builds a complete
+   new version and swaps it in, the old version is freed once no reader
+   that could have seen it is still reading. */
+struct config_version
+{
+    Hash_table *table;
+
+    /* Snapshot options are found in if they aren't in TABLE, or NULL. */
+    struct snapshot *snapshot;
+
+    /* File options are parsed from on first use if they aren't in
+       TABLE, or NULL. */
+    struct lazy *lazy;
+
+    /* If not NULL options are only looked up here and the version
+       can't change. The options are copies of those in BASE, which is
+       freed along with this version. */
+    struct frozen *frozen;
+    struct config_version *base;
+
+    /* Options, hash nodes and strings are allocated from here. */
+    Arena *arena;
+
+    struct mapping *mappings;
+
+    /* Bumped whenever an option is added or replaced. */
+    unsigned long generation;
+
+    /* Options lookups can find and elements of those that are arrays,
+       kept up to date as options are added so cConfig_get_stats
+       doesn't have to look at them. Options of a lazily loaded file
+       add their elements once they are parsed. */
+    size_t opt_count;
+    size_t elem_count;
+
+    /* Options of the resolved keys, see struct resolved. */
+    struct resolved *resolved;
+
+    /* Typed array caches and array indexes are allocated from
+       CACHE_ARENA with CACHE_LOCK held, see get_typed_array. These are
+       ARENA and LOCK, except in versions made by cConfig_watch, whose
+       options outlive them and are in WATCH_ARENA. */
+    Arena *cache_arena;
+    pthread_mutex_t *cache_lock;
+    pthread_mutex_t lock;
+    struct watch_arena *watch_arena;
+
+    /* Epoch the version was replaced in, and the next replaced
+       version waiting to be freed. */
+    unsigned long retired;
+    struct config_version *next;
+};
+
+/* A configuration. Contexts don't share anything, so different
+   threads can load and use different contexts at the same time. */
+struct cConfig_ctx
+{
+    /* The version readers use. Only loaded and stored atomically. */
+    struct config_version *current;
 
-static Hash_table *config_table = NULL;
+    /* Replaced versions and resolved arrays that might still have
+       readers. */
+    struct config_version *retired;
+    struct resolved *retired_resolved;
 
-static char delim = '=';
-static char comment = '#';
+    /* Serializes everything that changes CURRENT, RETIRED or KEYS. */
+    pthread_mutex_t write_lock;
 
-void 
+    /* Every key resolved in this context, by index. Indexes aren't
+       reused so a stale resolved array never maps a key to another
+       name. KEY_SLOTS finds the keys of a name: open addressing with
+       linear probing over KEY_MASK + 1 slots, each the index of a key
+       plus one, or 0. */
+    cConfig_key_t *keys;
+    size_t key_count;
+    size_t *key_slots;
+    size_t key_mask;
+
+    /* The file cConfig_watch keeps the table in sync with, or NULL. */
+    struct watch *watch;
+
+    /* Totals of the loads into the table, see cConfig_get_stats. Only
+       changed atomically, parallel loads add to them from every thread. */
+    uint64_t load_ns;
+    uint64_t load_bytes;
+    uint64_t load_lines;
+
+    char delim;
+    char comment;
+};
+
+/* An element of an array in a cConfig_index. */
+struct index_entry
+{
+    const char *value;
+    size_t len;
+};
+
+/* A slot of the hash set in a cConfig_index. */
+struct index_slot
+{
+    /* High bits of the hash of the element. */
+    uint32_t hash;
+
+    /* Number of the element plus one, 0 if the slot is empty. */
+    uint32_t elem;
+};
+
+/* What cConfig_find_opt_value searches a large array option through,
+   either a hash set or the elements in sorted order. */
+struct cConfig_index
+{
+    /* Number of slots in the hash set, a power of two, or 0 if the
+       array is searched through SORTED. */
+    size_t size;
+    struct index_slot *slots;
+
+    struct index_entry *sorted;
+};
+
+/* The context the functions without a context argument use. */
+static cConfig_ctx default_ctx =
+{
+    NULL, NULL, NULL, PTHREAD_MUTEX_INITIALIZER, NULL, 0, NULL, 0, NULL, 0, 0, 0, '=', '#'
+};
+
+void
 cConfig_error(const char *format, ...)
 {
     char buf[255];
@@ -58,309 +426,4599 @@ cConfig_error(const char *format, ...)
     va_end (vl);
 }
 
-void
-cConfig_init(void)
+static uint64_t
+now_ns(void)
 {
-    if (!config_table)
-        config_table = new_hash_table(TABLE_SIZE);
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
 }
 
-cConfig_opt *
-new_config_opt(const char *name, const char *value)
+static struct config_version *
+new_version(void)
 {
-    cConfig_opt *opt;
+    struct config_version *v;
 
-    opt = xmalloc(sizeof(cConfig_opt));
+    v = xmalloc(sizeof(struct config_version));
 
-    opt->name = dupstr(name);
-    opt->value = value == NULL ? NULL : dupstr(value);
+    v->arena = new_arena(ARENA_SIZE);
+    v->table = new_hash_table(TABLE_SIZE);
+    v->table->arena = v->arena;
+    v->snapshot = NULL;
+    v->lazy = NULL;
+    v->frozen = NULL;
+    v->base = NULL;
+    v->mappings = NULL;
+    v->generation = 1;
+    v->opt_count = 0;
+    v->elem_count = 0;
+    v->resolved = NULL;
+    v->retired = 0;
+    v->next = NULL;
 
-    opt->is_array = 0;
-    opt->size = 1;
+    pthread_mutex_init(&v->lock, NULL);
+    v->cache_lock = &v->lock;
+    v->cache_arena = v->arena;
+    v->watch_arena = NULL;
 
-    return opt;
+    return v;
 }
 
-cConfig_opt *
-cConfig_add_opt(const char *name, const char *value)
+/* Option I of snapshot S. The pointers in an option are offsets until
+   it is first used, the first thread to get to it turns them into
+   pointers while others wait. The mapping is private so this only
+   copies the pages that are touched. */
+static cConfig_opt *
+snapshot_opt(struct snapshot *s, size_t i)
 {
-    cConfig_opt *opt;
+    cConfig_opt *opt = &s->opts[i];
+    uint32_t state = RELOC_RAW;
+    size_t j;
+
+    if (__atomic_load_n(&s->states[i], __ATOMIC_ACQUIRE) == RELOC_DONE)
+        return opt;
+
+    if (__atomic_compare_exchange_n(&s->states[i], &state, RELOC_BUSY, 0,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+    {
+        opt->name = RELOCATE(s, opt->name);
+
+        if (opt->value)
+            opt->value = RELOCATE(s, opt->value);
+
+        if (opt->values)
+        {
+            opt->values = RELOCATE(s, opt->values);
+            opt->value_lens = RELOCATE(s, opt->value_lens);
 
-    opt = new_config_opt(name, value);
+            for (j = 0; j < opt->size; ++j)
+                opt->values[j] = RELOCATE(s, opt->values[j]);
+        }
 
-    insert_hash_node(name, (void *)opt, config_table);
+        __atomic_store_n(&s->states[i], RELOC_DONE, __ATOMIC_RELEASE);
+    }
+    else
+        while (__atomic_load_n(&s->states[i], __ATOMIC_ACQUIRE) != RELOC_DONE)
+            sched_yield();
 
     return opt;
 }
 
-cConfig_opt *
-cConfig_add_opt_array(const char *name, char **values, const size_t size)
+/* The slot of option NAME in snapshot S, H is its hash_string. NULL
+   if it isn't there. */
+static struct snapshot_slot *
+snapshot_slot(struct snapshot *s, const char *name, uint64_t h)
 {
-    cConfig_opt *opt;
+    struct snapshot_slot *slot;
 
-    opt = new_config_opt(name, NULL);
-    
-    opt->values = values;
-    opt->is_array = 1;
-    opt->size = size;
+    slot = &s->slots[h & s->mask];
 
-    insert_hash_node(name, (void *)opt, config_table);
+    while (slot->opt)
+    {
+        if (slot->hash == h && strcmp(s->base + slot->name, name) == 0)
+            return slot;
 
-    return opt;
+        if (++slot > &s->slots[s->mask])
+            slot = s->slots;
+    }
+
+    return NULL;
 }
 
-cConfig_opt *
-cConfig_get_opt(const char *name)
+static cConfig_opt *
+snapshot_lookup(struct snapshot *s, const char *name)
 {
-    cConfig_opt *opt;
-    Hash_node *node;
+    struct snapshot_slot *slot;
 
-    node = find_hash_node(name, config_table);
+    if ((slot = snapshot_slot(s, name, hash_string(name, strlen(name)))) == NULL)
+        return NULL;
 
-    if (node)
-        opt = node->data;
-    else
-        opt = NULL;
+    return snapshot_opt(s, slot->opt - 1);
+}
 
-    return opt;
+static uint64_t
+frozen_mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+
+    return x;
 }
 
-char *
-cConfig_get_value(const char *name)
+/* Slot of an option in a frozen table of N options. MIXED is
+   frozen_mix of its hash and SEED the seed of its bucket. */
+static size_t
+frozen_slot(uint64_t mixed, uint32_t seed, size_t n)
 {
-    char *value;
-    cConfig_opt *opt;
+    if (seed & FROZEN_DIRECT)
+        return seed & ~FROZEN_DIRECT;
 
-    opt = cConfig_get_opt(name);
+    return FROZEN_RANGE(frozen_mix(mixed ^ (seed * 0x9e3779b97f4a7c15ULL)) >> 32, n);
+}
 
-    if (opt)
-        value = opt->value;
-    else
-        value = NULL;
+/* One slot can hold NAME, it is either there or not at all. */
+static cConfig_opt *
+frozen_lookup(struct frozen *f, const char *name, uint64_t hash)
+{
+    uint64_t mixed;
+    size_t i;
 
-    return value;
+    if (f->count == 0)
+        return NULL;
+
+    mixed = frozen_mix(hash);
+    i = frozen_slot(mixed, f->seeds[FROZEN_RANGE(mixed, f->buckets)], f->count);
+
+    if (f->hashes[i] != hash || strcmp(f->opts[i].name, name) != 0)
+        return NULL;
+
+    return &f->opts[i];
 }
 
-void
-cConfig_set_delim(char d)
+static cConfig_opt *lazy_lookup(struct config_version *, const char *, uint64_t);
+
+static size_t lazy_find(struct config_version *, const char *, uint64_t);
+
+/* Find option NAME in V, HASH is what hash_key returns for it. Options
+   in the table hide those in the snapshot or lazily loaded file. */
+static cConfig_opt *
+find_opt_hashed(struct config_version *v, const char *name, uint64_t hash)
 {
-    delim = d;
+    Hash_node *node;
+
+    if (v->frozen)
+        return frozen_lookup(v->frozen, name, hash);
+
+    if ((node = find_hash_node_hashed(name, hash, v->table)) != NULL)
+        return node->data;
+
+    if (v->snapshot)
+        return snapshot_lookup(v->snapshot, name);
+
+    if (v->lazy)
+        return lazy_lookup(v, name, hash);
+
+    return NULL;
 }
 
-unsigned int
-cConfig_find_opt_value(char *name, char *value)
+/* The options of tables made by cConfig_watch, shared by the versions
+   that keep them. It is freed once the watch and every version using
+   it let go of it. */
+struct watch_arena
 {
-    size_t i;
-    cConfig_opt *opt;
+    Arena *arena;
+    pthread_mutex_t lock;
+    unsigned long refs;
+};
 
-    opt = cConfig_get_opt(name);
+static struct watch_arena *
+new_watch_arena(void)
+{
+    struct watch_arena *wa;
 
-    if (opt == NULL)
-        return 0;
+    wa = xmalloc(sizeof(struct watch_arena));
+    wa->arena = new_arena(ARENA_SIZE);
+    wa->refs = 1;
+    pthread_mutex_init(&wa->lock, NULL);
 
-    if (!opt->is_array)
-        return 0;
+    return wa;
+}
 
-    for (i = 0; i < opt->size; ++i)
-    {
-        if (streq(opt->values[i], value))
-            return 1;
-    }
+/* Have V keep its options and caches in WA. */
+static void
+use_watch_arena(struct config_version *v, struct watch_arena *wa)
+{
+    __atomic_add_fetch(&wa->refs, 1, __ATOMIC_RELAXED);
 
-    return 0;
+    v->watch_arena = wa;
+    v->cache_arena = wa->arena;
+    v->cache_lock = &wa->lock;
 }
 
-void
-cConfig_print_opt(char *name)
+static void
+release_watch_arena(struct watch_arena *wa)
 {
-    char **values;
-    size_t i;
-    cConfig_opt *opt;
+    if (__atomic_sub_fetch(&wa->refs, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
 
-    opt = cConfig_get_opt(name);
+    free_arena(wa->arena);
+    pthread_mutex_destroy(&wa->lock);
+    xfree(wa);
+}
 
-    if (opt == NULL)
-        puts("NULL ==> NULL");
+/* Release a version and everything loaded into it. Options live in
+   the arena so there is no need to walk the buckets. */
+static void
+free_version(struct config_version *v)
+{
+    struct mapping *map;
 
-    if (!opt->is_array)
+    for (map = v->mappings; map != NULL; map = map->next)
+        munmap(map->addr, map->len);
+
+    xfree(v->resolved);
+
+    if (v->frozen)
     {
-        fprintf(stdout, "NAME ==> %s\n", opt->name);
-        fprintf(stdout, "VALUE ==> %s\n", opt->value);
-        return;
+        xfree(v->frozen->seeds);
+        xfree(v->frozen->hashes);
+        xfree(v->frozen->opts);
+        xfree(v->frozen);
     }
 
-    values = opt->values;
+    if (v->base)
+        free_version(v->base);
+
+    if (v->lazy)
+    {
+        xfree(v->lazy->slots);
+        xfree(v->lazy->opts);
+    }
 
-    fprintf(stdout, "NAME ==> %s\n", opt->name);
+    free_hash_table(v->table);
+    free_arena(v->arena);
+    pthread_mutex_destroy(&v->lock);
 
-    for (i = 0; i < opt->size; ++i)
-        fprintf(stdout, "VALUE [%d] ==> %s\n", i, opt->values[i]);
+    if (v->watch_arena)
+        release_watch_arena(v->watch_arena);
 
+    xfree(v);
 }
 
-static unsigned int
-parse_line(char *string)
+/* Free the replaced versions and resolved arrays no reader can be
+   using anymore. Called with write_lock held. */
+static void
+reclaim(cConfig_ctx *ctx)
 {
-    char value[255], name[255], c;
-    unsigned int have_name, have_quote, have_paren;
-    char **values;
-    size_t i = 0, len;
-    
-    have_name = have_quote = have_paren = 0;
+    struct config_version **prev, *v;
+    struct resolved **rprev, *r;
 
-    while ((c = *string++) != '\0')
+    for (prev = &ctx->retired; (v = *prev) != NULL; )
     {
-        if (c == DQUOTE)
-        {
-            if (!have_name)
-            {
-                cConfig_error("unexpected '%c'", DQUOTE);
-                return 0;
-            }
-            if (have_quote && !END_LINE(*string))
-            {
-                cConfig_error("unexpected '%c' after '%c'", *string, DQUOTE);
-                return 0;
-            }
-            have_quote = !have_quote;
-        }
-        else 
-        if (c == ' ')
-        {
-            /* Ignore spaces outside of quotes. */
-            if (have_quote)
-                value[i++] = c;
-        }
-        else
-        if (c == delim)
-        {
-            if (have_name)
-            {
-                cConfig_error("unexpected '%c'", delim);
-                return 0;
-            }
-   
-            have_name = 1;
-            name[i] = '\0';
-            i = 0;
-        }
-        else
-        if (c == '\n')
-            break;
-        else
-        if (c == PAREN_OPEN)
+        if (epoch_passed(v->retired))
         {
-            if (!have_name)
-            {
-                cConfig_error("unexpected '%c'", PAREN_OPEN);
-                return 0;
-            }
-            have_paren = 1;
+            *prev = v->next;
+            free_version(v);
         }
         else
-        if (c == PAREN_CLOSE)
+            prev = &v->next;
+    }
+
+    for (rprev = &ctx->retired_resolved; (r = *rprev) != NULL; )
+    {
+        if (epoch_passed(r->retired))
         {
-            if (have_paren && !END_LINE(*string))
-            {
-                cConfig_error("unexpected '%c' after '%c'", *string, PAREN_CLOSE);
-                return 0;
-            }
+            *rprev = r->next;
+            xfree(r);
         }
         else
-        {
-            if (have_name)
-                value[i++] = c;
-            else
-                name[i++] = c;
-        }
+            rprev = &r->next;
     }
+}
 
-    value[i] = '\0';
+/* Look up the option of every key of CTX in V. Called with
+   write_lock held. */
+static void
+resolve_keys(cConfig_ctx *ctx, struct config_version *v)
+{
+    struct resolved *r, *old;
+    cConfig_key_t key;
+    size_t i, size;
 
-    if (!have_name)
-        return 1;
+    old = v->resolved;
+
+    if (old == NULL && ctx->key_count == 0)
+        return;
+
+    size = ctx->key_count < RESOLVED_MIN ? RESOLVED_MIN : ctx->key_count * 2;
+    r = xmalloc(sizeof(struct resolved) + size * sizeof(cConfig_opt *));
 
-    if (have_paren)
+    r->generation = v->generation;
+    r->count = ctx->key_count;
+    r->size = size;
+
+    for (i = 0; i < ctx->key_count; ++i)
     {
-        explode(value, ",", &values, &len);
-        cConfig_add_opt_array(name, values, len);
+        key = ctx->keys[i];
+        r->opts[i] = key ? find_opt_hashed(v, key->name, key->hash) : NULL;
     }
-    else
-        cConfig_add_opt(name, value);
 
-    return 1;
+    __atomic_store_n(&v->resolved, r, __ATOMIC_RELEASE);
+
+    /* A reader might still be looking at the old array. */
+    if (old)
+    {
+        old->retired = epoch_advance();
+        old->next = ctx->retired_resolved;
+        ctx->retired_resolved = old;
+
+        reclaim(ctx);
+    }
 }
 
-unsigned int
-cConfig_load(const char *filename)
+/* Add KEY, just registered in CTX, to the resolved options of V. Only
+   when there is no room left for it are all keys resolved again.
+   Called with write_lock held. */
+static void
+resolve_key(cConfig_ctx *ctx, struct config_version *v, cConfig_key_t key)
 {
-    FILE *f;
-    char line[255];
+    struct resolved *r = v->resolved;
 
-    if ((f = fopen(filename, "r")) == NULL)
-        return 0;
-        
-    while (fgets(line, 255, f) != NULL)
+    if (r == NULL || r->generation != v->generation ||
+        key->index != r->count || key->index >= r->size)
     {
-        /* Ignore lines that start with a comment character. */
-        if (*line == comment)
-            continue;
+        resolve_keys(ctx, v);
+        return;
+    }
 
-        if (!parse_line(line))
-        {
-            fclose(f);
-            return 0;
-        }
+    r->opts[key->index] = find_opt_hashed(v, key->name, key->hash);
+    __atomic_store_n(&r->count, key->index + 1, __ATOMIC_RELEASE);
+}
+
+/* Point the keys of CTX named like OPT, which was just put in V, at it
+   rather than resolving every key again. Called with write_lock
+   held. */
+static void
+resolve_opt(cConfig_ctx *ctx, struct config_version *v, cConfig_opt *opt)
+{
+    struct resolved *r = v->resolved;
+    cConfig_key_t key;
+    uint64_t hash;
+    size_t i, j;
+
+    /* Unless only OPT changed V since the array was made, there is
+       more to look up again. */
+    if (r == NULL || r->generation + 1 != v->generation)
+    {
+        resolve_keys(ctx, v);
+        return;
     }
-    
-    fclose(f);
-    return 1;
+
+    hash = hash_key(opt->name);
+
+    for (i = hash & ctx->key_mask; (j = ctx->key_slots[i]) != 0; i = (i + 1) & ctx->key_mask)
+    {
+        key = ctx->keys[j - 1];
+
+        if (key && key->hash == hash && key->index < r->count && streq(key->name, opt->name))
+            __atomic_store_n(&r->opts[key->index], opt, __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(&r->generation, v->generation, __ATOMIC_RELEASE);
+}
+
+/* Get V ready for readers after a load: finish growing the table, so
+   lookups only have one array of buckets to look in, and resolve the
+   keys again. Single options added by cConfig_add_opt leave the table
+   to grow a few buckets per insert instead. Called with write_lock
+   held. */
+static void
+publish(cConfig_ctx *ctx, struct config_version *v)
+{
+    finish_rehash(v->table);
+    resolve_keys(ctx, v);
+}
+
+/* Make V the current version and put the old one, if any, on the
+   retired list. Called with write_lock held. */
+static void
+replace_version(cConfig_ctx *ctx, struct config_version *v)
+{
+    struct config_version *old;
+
+    old = __atomic_exchange_n(&ctx->current, v, __ATOMIC_SEQ_CST);
+
+    if (old)
+    {
+        old->retired = epoch_advance();
+        old->next = ctx->retired;
+        ctx->retired = old;
+    }
+
+    reclaim(ctx);
+}
+
+/* The current version of CTX, callers must be inside an epoch. */
+static struct config_version *
+current_version(cConfig_ctx *ctx)
+{
+    return __atomic_load_n(&ctx->current, __ATOMIC_SEQ_CST);
+}
+
+/* Add a load into the table of CTX that started at START to its
+   totals. */
+static void
+count_load(cConfig_ctx *ctx, uint64_t start)
+{
+    __atomic_add_fetch(&ctx->load_ns, now_ns() - start, __ATOMIC_RELAXED);
+}
+
+static unsigned int watching(cConfig_ctx *);
+
+/* Non zero, after complaining, if the table of CTX can't be changed
+   in place: it was frozen by cConfig_freeze or mirrors a file watched
+   by cConfig_watch. Called with write_lock held. */
+static unsigned int
+is_read_only(cConfig_ctx *ctx)
+{
+    struct config_version *v = ctx->current;
+
+    if (v == NULL)
+        return 0;
+
+    if (v->frozen)
+    {
+        cConfig_error("the table is frozen, use cConfig_reload to replace it");
+        return 1;
+    }
+
+    if (watching(ctx))
+    {
+        cConfig_error("the table is watched, change the file instead");
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Give CTX an empty table if it doesn't have one. */
+static void
+init_ctx(cConfig_ctx *ctx)
+{
+    struct config_version *v;
+
+    pthread_mutex_lock(&ctx->write_lock);
+
+    if (ctx->current == NULL)
+    {
+        v = new_version();
+
+        publish(ctx, v);
+        replace_version(ctx, v);
+    }
+
+    pthread_mutex_unlock(&ctx->write_lock);
+}
+
+static void stop_watch(cConfig_ctx *);
+
+static void free_watch(cConfig_ctx *);
+
+/* Free the table of CTX after waiting for the threads still reading
+   it. Keys stay registered. */
+static void
+free_ctx(cConfig_ctx *ctx)
+{
+    struct config_version *v;
+    struct resolved *r;
+
+    PROFILE_START(PROFILE_FREE);
+
+    /* The watch thread takes write_lock itself. */
+    stop_watch(ctx);
+
+    pthread_mutex_lock(&ctx->write_lock);
+
+    replace_version(ctx, NULL);
+
+    while ((v = ctx->retired) != NULL)
+    {
+        epoch_wait(v->retired);
+        ctx->retired = v->next;
+        free_version(v);
+    }
+
+    while ((r = ctx->retired_resolved) != NULL)
+    {
+        epoch_wait(r->retired);
+        ctx->retired_resolved = r->next;
+        xfree(r);
+    }
+
+    ctx->load_ns = 0;
+    ctx->load_bytes = 0;
+    ctx->load_lines = 0;
+
+    pthread_mutex_unlock(&ctx->write_lock);
+
+    free_watch(ctx);
+
+    PROFILE_END(PROFILE_FREE);
+}
+
+/* Create a context with an empty table. */
+cConfig_ctx *
+cConfig_ctx_new(void)
+{
+    cConfig_ctx *ctx;
+
+    ctx = xmalloc(sizeof(cConfig_ctx));
+
+    ctx->current = NULL;
+    ctx->retired = NULL;
+    ctx->retired_resolved = NULL;
+    ctx->keys = NULL;
+    ctx->key_count = 0;
+    ctx->key_slots = NULL;
+    ctx->key_mask = 0;
+    ctx->watch = NULL;
+    ctx->load_ns = 0;
+    ctx->load_bytes = 0;
+    ctx->load_lines = 0;
+    ctx->delim = '=';
+    ctx->comment = '#';
+
+    pthread_mutex_init(&ctx->write_lock, NULL);
+    init_ctx(ctx);
+
+    return ctx;
 }
 
+/* Free CTX and everything loaded into it. Keys resolved in CTX have to
+   be passed to cConfig_free_key still, they don't find anything anymore. */
 void
-cConfig_free_opt(cConfig_opt *opt)
+cConfig_ctx_free(cConfig_ctx *ctx)
 {
     size_t i;
 
-    if (opt->is_array)
+    free_ctx(ctx);
+
+    for (i = 0; i < ctx->key_count; ++i)
+        if (ctx->keys[i])
+            ctx->keys[i]->ctx = NULL;
+
+    xfree(ctx->keys);
+    xfree(ctx->key_slots);
+    pthread_mutex_destroy(&ctx->write_lock);
+    xfree(ctx);
+}
+
+static cConfig_opt *
+new_config_opt(struct config_version *v, const char *name, const char *value)
+{
+    cConfig_opt *opt;
+
+    opt = arena_alloc(v->arena, sizeof(cConfig_opt));
+
+    opt->name = arena_dupstr(v->arena, name);
+    opt->name_len = strlen(name);
+
+    if (value == NULL)
     {
-        for (i = 0; i < opt->size; ++i)
-            xfree(opt->values[i]);
+        opt->value = NULL;
+        opt->value_len = 0;
+    }
+    else
+    {
+        opt->value = arena_dupstr(v->arena, value);
+        opt->value_len = strlen(value);
+    }
+
+    opt->values = NULL;
+    opt->value_lens = NULL;
+    opt->is_array = 0;
+    opt->is_mapped = 0;
+    opt->size = 1;
+    opt->cache_type = CCONFIG_NONE;
+    opt->int_values = NULL;
+    opt->double_values = NULL;
+    opt->index = NULL;
+
+    return opt;
+}
+
+/* Non zero if OPT, just put in the table of V, hides an option of the
+   snapshot or lazily loaded file of V, whose elements then stop being
+   counted. Neither is relocated or parsed to find out. */
+static unsigned int
+hide_opt(struct config_version *v, const cConfig_opt *opt)
+{
+    struct snapshot_slot *slot;
+    cConfig_opt *hidden = NULL;
+    size_t i;
+
+    if (v->snapshot)
+    {
+        slot = snapshot_slot(v->snapshot, opt->name, hash_string(opt->name, opt->name_len));
 
-        xfree(opt->values);
+        /* The size of an option doesn't need relocating. */
+        if (slot)
+            hidden = &v->snapshot->opts[slot->opt - 1];
     }
     else
-        xfree(opt->value);
-    
-    xfree(opt->name);
-    xfree(opt);
+    if (v->lazy)
+    {
+        if ((i = lazy_find(v, opt->name, hash_key(opt->name))) == (size_t)-1)
+            return 0;
+
+        /* Elements of an option that wasn't parsed aren't counted. */
+        if ((hidden = __atomic_load_n(&v->lazy->opts[i], __ATOMIC_ACQUIRE)) == NULL)
+            return 1;
+    }
+
+    if (hidden == NULL)
+        return 0;
+
+    if (hidden->is_array)
+        __atomic_sub_fetch(&v->elem_count, hidden->size, __ATOMIC_RELAXED);
+
+    return 1;
+}
+
+/* Put OPT in the table of V, replacing an option of the same name, and
+   count it. */
+static cConfig_opt *
+insert_opt(struct config_version *v, cConfig_opt *opt)
+{
+    cConfig_opt *old;
+
+    insert_hash_node(opt->name, (void *)opt, v->table);
+    v->generation++;
+
+    if ((old = v->table->replaced) != NULL)
+    {
+        if (old->is_array)
+            __atomic_sub_fetch(&v->elem_count, old->size, __ATOMIC_RELAXED);
+    }
+    else
+    if (!hide_opt(v, opt))
+        v->opt_count++;
+
+    if (opt->is_array)
+        __atomic_add_fetch(&v->elem_count, opt->size, __ATOMIC_RELAXED);
+
+    return opt;
+}
+
+/* Add an option to the current table. Like cConfig_load this changes
+   the table in place, use cConfig_reload while other threads read. */
+cConfig_opt *
+cConfig_ctx_add_opt(cConfig_ctx *ctx, const char *name, const char *value)
+{
+    struct config_version *v;
+    cConfig_opt *opt;
+
+    pthread_mutex_lock(&ctx->write_lock);
+
+    if (is_read_only(ctx))
+    {
+        pthread_mutex_unlock(&ctx->write_lock);
+        return NULL;
+    }
+
+    v = ctx->current;
+    opt = insert_opt(v, new_config_opt(v, name, value));
+    resolve_opt(ctx, v, opt);
+
+    pthread_mutex_unlock(&ctx->write_lock);
+
+    return opt;
+}
+
+/* Add an array option, VALUES is copied into a single block laid out
+   the same as the arrays split_values makes. */
+cConfig_opt *
+cConfig_ctx_add_opt_array(cConfig_ctx *ctx, const char *name, char **values, const size_t size)
+{
+    struct config_version *v;
+    cConfig_opt *opt;
+    size_t i, bytes, *lens;
+    char *out;
+
+    bytes = size * (sizeof(char *) + sizeof(size_t));
+
+    for (i = 0; i < size; ++i)
+        bytes += strlen(values[i]) + 1;
+
+    pthread_mutex_lock(&ctx->write_lock);
+
+    if (is_read_only(ctx))
+    {
+        pthread_mutex_unlock(&ctx->write_lock);
+        return NULL;
+    }
+
+    v = ctx->current;
+    opt = new_config_opt(v, name, NULL);
+
+    opt->values = arena_alloc(v->arena, bytes);
+    lens = (size_t *)(opt->values + size);
+    out = (char *)(lens + size);
+
+    for (i = 0; i < size; ++i)
+    {
+        lens[i] = strlen(values[i]);
+        memcpy(out, values[i], lens[i] + 1);
+        opt->values[i] = out;
+        out += lens[i] + 1;
+    }
+
+    opt->value_lens = lens;
+    opt->is_array = 1;
+    opt->size = size;
+
+    insert_opt(v, opt);
+    resolve_opt(ctx, v, opt);
+
+    pthread_mutex_unlock(&ctx->write_lock);
+
+    return opt;
+}
+
+static cConfig_opt *
+lookup_opt(struct config_version *v, const char *name)
+{
+    cConfig_opt *opt;
+
+    if (v == NULL)
+        return NULL;
+
+    opt = find_opt_hashed(v, name, hash_key(name));
+    COUNT_LOOKUP(opt);
+
+    return opt;
 }
 
+/* Enter or leave a read side critical section. Lookups are safe to run
+   while another thread calls cConfig_reload, but what they return only
+   stays valid while the caller is inside one. Calls nest. */
 void
-cConfig_free(void)
+cConfig_read_lock(void)
 {
-    size_t i;
-    Hash_node *node, *temp;
+    epoch_enter();
+}
+
+void
+cConfig_read_unlock(void)
+{
+    epoch_leave();
+}
+
+cConfig_opt *
+cConfig_ctx_get_opt(cConfig_ctx *ctx, const char *name)
+{
+    cConfig_opt *opt;
+
+    PROFILE_START(PROFILE_GET_OPT);
+
+    epoch_enter();
+    opt = lookup_opt(current_version(ctx), name);
+    epoch_leave();
+
+    PROFILE_END(PROFILE_GET_OPT);
+
+    return opt;
+}
+
+char *
+cConfig_ctx_get_value(cConfig_ctx *ctx, const char *name)
+{
+    char *value;
     cConfig_opt *opt;
 
-    for (i = 0; i < config_table->size; ++i)
+    epoch_enter();
+
+    opt = lookup_opt(current_version(ctx), name);
+
+    if (opt)
+        value = opt->value;
+    else
+        value = NULL;
+
+    epoch_leave();
+
+    return value;
+}
+
+/* Put KEY in the first empty slot from its hash on. */
+static void
+put_key_slot(cConfig_ctx *ctx, cConfig_key_t key)
+{
+    size_t i;
+
+    for (i = key->hash & ctx->key_mask; ctx->key_slots[i] != 0; i = (i + 1) & ctx->key_mask)
+        ;
+
+    ctx->key_slots[i] = key->index + 1;
+}
+
+/* Put KEY, the last key registered in CTX, in the slots the keys of a
+   name are found through, growing them to keep at least half empty.
+   Called with write_lock held. */
+static void
+add_key_slot(cConfig_ctx *ctx, cConfig_key_t key)
+{
+    size_t i, size;
+
+    if (ctx->key_count * 2 > ctx->key_mask)
     {
-        node = config_table->nodes[i];
+        size = ctx->key_slots ? (ctx->key_mask + 1) * 2 : RESOLVED_MIN;
 
-        while (node)
-        {
-            opt = (cConfig_opt *)node->data;
-            cConfig_free_opt(opt);
+        xfree(ctx->key_slots);
+        ctx->key_slots = xcalloc(size, sizeof(size_t));
+        ctx->key_mask = size - 1;
 
-            temp = node;
-            node = node->next;
-            xfree(temp->key);
-            xfree(temp);
-        }
-        config_table->nodes[i] = NULL;
+        /* Freed keys don't get a slot again. */
+        for (i = 0; i < key->index; ++i)
+            if (ctx->keys[i])
+                put_key_slot(ctx, ctx->keys[i]);
+    }
+
+    put_key_slot(ctx, key);
+}
+
+/* Hash NAME once and return a key that finds its option without
+   hashing or comparing NAME again. */
+cConfig_key_t
+cConfig_ctx_resolve(cConfig_ctx *ctx, const char *name)
+{
+    cConfig_key_t key;
+
+    key = xmalloc(sizeof(struct cConfig_key));
+
+    key->name = dupstr(name);
+    key->hash = hash_key(name);
+    key->ctx = ctx;
+
+    pthread_mutex_lock(&ctx->write_lock);
+
+    ctx->keys = xrealloc(ctx->keys, (ctx->key_count + 1) * sizeof(cConfig_key_t));
+    key->index = ctx->key_count;
+    ctx->keys[ctx->key_count++] = key;
+    add_key_slot(ctx, key);
+
+    if (ctx->current)
+        resolve_key(ctx, ctx->current, key);
+
+    pthread_mutex_unlock(&ctx->write_lock);
+
+    return key;
+}
+
+/* Same as cConfig_get_opt, for a key returned by cConfig_resolve. Every
+   version looks up the options of all keys when it is loaded, so this
+   is an index into an array, kept up to date by cConfig_add_opt. While
+   it is out of date the option is looked up with the hash stored in
+   the key. */
+cConfig_opt *
+cConfig_get_opt_by_key(cConfig_key_t key)
+{
+    struct config_version *v;
+    struct resolved *r;
+    cConfig_opt *opt = NULL;
+
+    epoch_enter();
+
+    if (key->ctx && (v = current_version(key->ctx)) != NULL)
+    {
+        r = __atomic_load_n(&v->resolved, __ATOMIC_ACQUIRE);
+
+        if (r && key->index < __atomic_load_n(&r->count, __ATOMIC_ACQUIRE) &&
+            __atomic_load_n(&r->generation, __ATOMIC_ACQUIRE) == v->generation)
+            opt = __atomic_load_n(&r->opts[key->index], __ATOMIC_RELAXED);
+        else
+            opt = find_opt_hashed(v, key->name, key->hash);
     }
 
-    xfree(config_table->nodes);
-    xfree(config_table);
+    epoch_leave();
+
+    return opt;
 }
 
+char *
+cConfig_get_value_by_key(cConfig_key_t key)
+{
+    cConfig_opt *opt;
+    char *value;
+
+    epoch_enter();
+
+    opt = cConfig_get_opt_by_key(key);
+    value = opt ? opt->value : NULL;
+
+    epoch_leave();
+
+    return value;
+}
+
+void
+cConfig_free_key(cConfig_key_t key)
+{
+    cConfig_ctx *ctx = key->ctx;
+
+    if (ctx)
+    {
+        pthread_mutex_lock(&ctx->write_lock);
+        ctx->keys[key->index] = NULL;
+        pthread_mutex_unlock(&ctx->write_lock);
+    }
+
+    xfree(key->name);
+    xfree(key);
+}
+
+void
+cConfig_ctx_set_delim(cConfig_ctx *ctx, char d)
+{
+    ctx->delim = d;
+}
+
+/* Sort by length first, what order doesn't matter as long as there
+   is one. */
+static int
+compare_entries(const void *a, const void *b)
+{
+    const struct index_entry *x = a, *y = b;
+
+    if (x->len != y->len)
+        return x->len < y->len ? -1 : 1;
+
+    return memcmp(x->value, y->value, x->len);
+}
+
+/* Build the index of array option OPT, from the cache arena of the
+   version it belongs to. */
+static struct cConfig_index *
+build_index(struct config_version *v, cConfig_opt *opt)
+{
+    struct cConfig_index *index;
+    struct index_slot *slot;
+    uint64_t h;
+    size_t i;
+
+    index = arena_alloc(v->cache_arena, sizeof(struct cConfig_index));
+
+    index->size = 0;
+    index->slots = NULL;
+    index->sorted = NULL;
+
+    if (opt->size >= INDEX_HASHED_MIN && opt->size < UINT32_MAX)
+    {
+        /* At most half full, so misses stop early. */
+        for (index->size = 1; index->size < opt->size * 2; index->size <<= 1)
+            ;
+
+        index->slots = arena_alloc(v->cache_arena, index->size * sizeof(struct index_slot));
+        memset(index->slots, 0, index->size * sizeof(struct index_slot));
+
+        for (i = 0; i < opt->size; ++i)
+        {
+            h = hash_string(opt->values[i], opt->value_lens[i]);
+            slot = &index->slots[h & (index->size - 1)];
+
+            while (slot->elem)
+                if (++slot == index->slots + index->size)
+                    slot = index->slots;
+
+            slot->hash = h >> 32;
+            slot->elem = i + 1;
+        }
+    }
+    else
+    {
+        index->sorted = arena_alloc(v->cache_arena, opt->size * sizeof(struct index_entry));
+
+        for (i = 0; i < opt->size; ++i)
+        {
+            index->sorted[i].value = opt->values[i];
+            index->sorted[i].len = opt->value_lens[i];
+        }
+
+        qsort(index->sorted, opt->size, sizeof(struct index_entry), compare_entries);
+    }
+
+    return index;
+}
+
+/* Non zero if array option OPT of version V has an element VALUE of
+   LEN bytes. Small arrays are scanned, larger ones get an index the
+   first time they are searched. */
+static unsigned int
+array_has(struct config_version *v, cConfig_opt *opt, const char *value, size_t len)
+{
+    struct cConfig_index *index;
+    struct index_slot *slot;
+    struct index_entry key, *entry;
+    uint64_t h;
+    size_t i;
+
+    if (opt->size < INDEX_SORTED_MIN)
+    {
+        for (i = 0; i < opt->size; ++i)
+            if (opt->value_lens[i] == len && memcmp(opt->values[i], value, len) == 0)
+                return 1;
+
+        return 0;
+    }
+
+    if ((index = __atomic_load_n(&opt->index, __ATOMIC_ACQUIRE)) == NULL)
+    {
+        /* Once per option, the arena isn't thread safe. */
+        pthread_mutex_lock(v->cache_lock);
+
+        if ((index = opt->index) == NULL)
+        {
+            index = build_index(v, opt);
+            __atomic_store_n(&opt->index, index, __ATOMIC_RELEASE);
+        }
+
+        pthread_mutex_unlock(v->cache_lock);
+    }
+
+    if (index->slots)
+    {
+        h = hash_string(value, len);
+        slot = &index->slots[h & (index->size - 1)];
+
+        while (slot->elem)
+        {
+            i = slot->elem - 1;
+
+            if (slot->hash == (uint32_t)(h >> 32) && opt->value_lens[i] == len &&
+                memcmp(opt->values[i], value, len) == 0)
+                return 1;
+
+            if (++slot == index->slots + index->size)
+                slot = index->slots;
+        }
+
+        return 0;
+    }
+
+    key.value = value;
+    key.len = len;
+
+    entry = bsearch(&key, index->sorted, opt->size, sizeof(struct index_entry), compare_entries);
+
+    return entry != NULL;
+}
+
+/* Non zero if array option NAME has an element VALUE of LEN bytes,
+   VALUE doesn't have to be NUL terminated. */
+unsigned int
+cConfig_ctx_find_opt_value_n(cConfig_ctx *ctx, const char *name, const char *value, size_t len)
+{
+    struct config_version *v;
+    cConfig_opt *opt;
+    unsigned int found = 0;
+
+    PROFILE_START(PROFILE_FIND_OPT_VALUE);
+
+    epoch_enter();
+
+    v = current_version(ctx);
+    opt = lookup_opt(v, name);
+
+    if (opt && opt->is_array)
+        found = array_has(v, opt, value, len);
+
+    epoch_leave();
+
+    PROFILE_END(PROFILE_FIND_OPT_VALUE);
+
+    return found;
+}
+
+unsigned int
+cConfig_ctx_find_opt_value(cConfig_ctx *ctx, char *name, char *value)
+{
+    return cConfig_ctx_find_opt_value_n(ctx, name, value, strlen(value));
+}
+
+/* Parse STRING as TYPE into VALUE. */
+static unsigned int
+parse_typed(const char *string, unsigned int type, void *value)
+{
+    switch (type)
+    {
+    case CCONFIG_INT:
+        return parse_int(string, value);
+    case CCONFIG_DOUBLE:
+        return parse_double(string, value);
+    case CCONFIG_BOOL:
+        return parse_bool(string, value);
+    case CCONFIG_BYTES:
+        return parse_bytes(string, value);
+    case CCONFIG_DURATION:
+        return parse_duration(string, value);
+    }
+
+    return 0;
+}
+
+/* Size of a value of TYPE as parse_typed stores it. */
+static size_t
+typed_size(unsigned int type)
+{
+    switch (type)
+    {
+    case CCONFIG_DOUBLE:
+        return sizeof(double);
+    case CCONFIG_BOOL:
+        return sizeof(unsigned int);
+    default:
+        return sizeof(int64_t);
+    }
+}
+
+/* Store the value of option NAME parsed as TYPE in VALUE. The first
+   type an option is read as is cached in the option, so reading it as
+   that type again is a plain copy. Returns 0 if there is no such
+   (non array) option or its value doesn't parse. */
+static unsigned int
+get_typed(cConfig_ctx *ctx, const char *name, unsigned int type, void *value)
+{
+    cConfig_opt *opt;
+    unsigned int cached, found = 0;
+
+    epoch_enter();
+
+    opt = lookup_opt(current_version(ctx), name);
+
+    if (opt == NULL || opt->is_array)
+        goto out;
+
+    cached = __atomic_load_n(&opt->cache_type, __ATOMIC_ACQUIRE);
+
+    if (cached == type)
+    {
+        memcpy(value, &opt->cache, typed_size(type));
+        found = 1;
+        goto out;
+    }
+
+    if (!parse_typed(opt->value, type, value))
+        goto out;
+
+    found = 1;
+
+    /* Whoever gets to claim the empty cache fills it in, everyone else
+       keeps parsing until it is published. */
+    if (cached == CCONFIG_NONE &&
+        __atomic_compare_exchange_n(&opt->cache_type, &cached, CACHE_BUSY, 0,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    {
+        memcpy(&opt->cache, value, typed_size(type));
+        __atomic_store_n(&opt->cache_type, type, __ATOMIC_RELEASE);
+    }
+
+out:
+    epoch_leave();
+    return found;
+}
+
+/* Parse every element of array option NAME as TYPE into one contiguous
+   array, which is cached in the option. Returns NULL if there is no such
+   array or one of its elements doesn't parse. */
+static void *
+get_typed_array(cConfig_ctx *ctx, const char *name, unsigned int type, size_t *size)
+{
+    struct config_version *v;
+    cConfig_opt *opt;
+    void **cache;
+    char *values = NULL;
+    double scratch;
+    size_t i, n;
+
+    epoch_enter();
+
+    v = current_version(ctx);
+    opt = lookup_opt(v, name);
+
+    if (opt == NULL || !opt->is_array)
+        goto out;
+
+    if (type == CCONFIG_INT)
+        cache = (void **)&opt->int_values;
+    else
+        cache = (void **)&opt->double_values;
+
+    if ((values = __atomic_load_n(cache, __ATOMIC_ACQUIRE)) == NULL)
+    {
+        /* Check every element first, a failed parse shouldn't leave
+           an array behind in the arena. */
+        for (i = 0; i < opt->size; ++i)
+            if (!parse_typed(opt->values[i], type, &scratch))
+                goto out;
+
+        /* The arena isn't thread safe, this only happens once per
+           option so a lock is fine. */
+        pthread_mutex_lock(v->cache_lock);
+
+        if ((values = *cache) == NULL)
+        {
+            n = typed_size(type);
+            values = arena_alloc(v->cache_arena, opt->size * n);
+
+            for (i = 0; i < opt->size; ++i)
+                parse_typed(opt->values[i], type, values + i * n);
+
+            __atomic_store_n(cache, values, __ATOMIC_RELEASE);
+        }
+
+        pthread_mutex_unlock(v->cache_lock);
+    }
+
+    *size = opt->size;
+
+out:
+    epoch_leave();
+    return values;
+}
+
+unsigned int
+cConfig_ctx_get_int(cConfig_ctx *ctx, const char *name, int64_t *value)
+{
+    return get_typed(ctx, name, CCONFIG_INT, value);
+}
+
+unsigned int
+cConfig_ctx_get_double(cConfig_ctx *ctx, const char *name, double *value)
+{
+    return get_typed(ctx, name, CCONFIG_DOUBLE, value);
+}
+
+unsigned int
+cConfig_ctx_get_bool(cConfig_ctx *ctx, const char *name, unsigned int *value)
+{
+    return get_typed(ctx, name, CCONFIG_BOOL, value);
+}
+
+unsigned int
+cConfig_ctx_get_bytes(cConfig_ctx *ctx, const char *name, uint64_t *value)
+{
+    return get_typed(ctx, name, CCONFIG_BYTES, value);
+}
+
+unsigned int
+cConfig_ctx_get_duration(cConfig_ctx *ctx, const char *name, int64_t *value)
+{
+    return get_typed(ctx, name, CCONFIG_DURATION, value);
+}
+
+int64_t *
+cConfig_ctx_get_int_array(cConfig_ctx *ctx, const char *name, size_t *size)
+{
+    return get_typed_array(ctx, name, CCONFIG_INT, size);
+}
+
+double *
+cConfig_ctx_get_double_array(cConfig_ctx *ctx, const char *name, size_t *size)
+{
+    return get_typed_array(ctx, name, CCONFIG_DOUBLE, size);
+}
+
+void
+cConfig_ctx_print_opt(cConfig_ctx *ctx, char *name)
+{
+    char **values;
+    size_t i;
+    cConfig_opt *opt;
+
+    epoch_enter();
+
+    opt = lookup_opt(current_version(ctx), name);
+
+    if (opt == NULL)
+        puts("NULL ==> NULL");
+    else
+    if (!opt->is_array)
+    {
+        fprintf(stdout, "NAME ==> %s\n", opt->name);
+        fprintf(stdout, "VALUE ==> %s\n", opt->value);
+    }
+    else
+    {
+        values = opt->values;
+
+        fprintf(stdout, "NAME ==> %s\n", opt->name);
+
+        for (i = 0; i < opt->size; ++i)
+            fprintf(stdout, "VALUE [%zu] ==> %s\n", i, values[i]);
+    }
+
+    epoch_leave();
+}
+
+/* Split the array VALUE of LEN bytes on commas into OPT, skipping empty
+   elements the way strtok would. The element table, the lengths of the
+   elements and, unless IS_MAPPED, the elements themselves are a single
+   allocation. Mapped elements are terminated in place and point into
+   VALUE, which has to be NUL terminated. */
+static void
+split_values(struct config_version *v, cConfig_opt *opt, char *value, size_t len,
+             unsigned int is_mapped)
+{
+    char *end, *comma, *out, **values;
+    size_t count = 1, bytes, n, *lens;
+
+    end = value + len;
+
+    for (comma = value; (comma = memchr(comma, ',', end - comma)) != NULL; ++comma)
+        count++;
+
+    /* The elements never take more than VALUE did, each one loses at
+       least its comma to the NUL. */
+    bytes = count * (sizeof(char *) + sizeof(size_t));
+
+    if (!is_mapped)
+        bytes += len + 1;
+
+    values = arena_alloc(v->arena, bytes);
+    lens = (size_t *)(values + count);
+    out = (char *)(lens + count);
+
+    count = 0;
+
+    while (value < end)
+    {
+        if ((comma = memchr(value, ',', end - value)) == NULL)
+            comma = end;
+
+        if ((n = comma - value) > 0)
+        {
+            if (is_mapped)
+            {
+                *comma = '\0';
+                values[count] = value;
+            }
+            else
+            {
+                memcpy(out, value, n);
+                out[n] = '\0';
+                values[count] = out;
+                out += n + 1;
+            }
+
+            lens[count++] = n;
+        }
+
+        value = comma + 1;
+    }
+
+    opt->values = count ? values : NULL;
+    opt->value_lens = count ? lens : NULL;
+    opt->size = count;
+}
+
+/* Non zero unless the line at STRING has a name that doesn't start
+   with one of the prefixes of FILTER. The name is read as it is in the
+   line, skipping the characters parse_line leaves out of it. */
+static unsigned int
+filter_match(const struct filter *filter, const char *string, const char *end, char delim)
+{
+    const char *name = string;
+    size_t i, j;
+
+    while (string < end && !END_LINE(*string) && *string != delim)
+        string++;
+
+    if (string == end || *string != delim)
+        return 1;
+
+    for (i = 0; i < filter->count; ++i)
+    {
+        for (j = 0, string = name; j < filter->lens[i] && *string != delim; ++string)
+        {
+            if (*string == ' ' || *string == PAREN_CLOSE)
+                continue;
+
+            if (*string != filter->prefixes[i][j])
+                break;
+
+            j++;
+        }
+
+        if (j == filter->lens[i])
+            return 1;
+    }
+
+    return 0;
+}
+
+/* Tokenize the line starting at STRING, which ends at the first newline
+   or at END. The name and value are compacted into the line itself and
+   NUL terminated, so the buffer has to be writable and, if the line has
+   no trailing newline, have room for one more byte at END. On return
+   *NEXT points to the start of the following line and LINE->name is NULL
+   if the line holds no option. If FILTER is not NULL lines with a name
+   it doesn't match are skipped before anything is compacted, so they
+   are only read up to the delimiter and never written to. */
+static unsigned int
+parse_line(char *string, char *end, char **next, struct line *line, char delim,
+           const struct filter *filter)
+{
+    char *out, *run, c;
+    unsigned int have_name, have_quote, have_paren;
+    
+    have_name = have_quote = have_paren = 0;
+
+    line->name = out = string;
+    line->value = NULL;
+    line->is_array = 0;
+
+    if (filter && !filter_match(filter, string, end, delim))
+    {
+        if ((string = memchr(string, '\n', end - string)) == NULL)
+            string = end;
+        else
+            string++;
+
+        *next = string;
+        line->name = NULL;
+        return 1;
+    }
+
+    while (string < end)
+    {
+        /* Copy everything up to the next character that needs a
+           closer look in one go. */
+        run = (char *)scan_line(string, end, delim);
+
+        if (run > string)
+        {
+            if (out != string)
+                memmove(out, string, run - string);
+
+            out += run - string;
+            string = run;
+
+            if (string == end)
+                break;
+        }
+
+        c = *string++;
+
+        if (END_LINE(c))
+            break;
+        else
+        if (c == DQUOTE)
+        {
+            if (!have_name)
+            {
+                cConfig_error("unexpected '%c'", DQUOTE);
+                return 0;
+            }
+            if (have_quote && !AT_END(string, end))
+            {
+                cConfig_error("unexpected '%c' after '%c'", *string, DQUOTE);
+                return 0;
+            }
+            have_quote = !have_quote;
+        }
+        else 
+        if (c == ' ')
+        {
+            /* Ignore spaces outside of quotes. */
+            if (have_quote)
+                *out++ = c;
+        }
+        else
+        if (c == delim)
+        {
+            if (have_name)
+            {
+                cConfig_error("unexpected '%c'", delim);
+                return 0;
+            }
+   
+            have_name = 1;
+            line->name_len = out - line->name;
+
+            *out++ = '\0';
+            line->value = out;
+        }
+        else
+        if (c == PAREN_OPEN)
+        {
+            if (!have_name)
+            {
+                cConfig_error("unexpected '%c'", PAREN_OPEN);
+                return 0;
+            }
+            have_paren = 1;
+        }
+        else
+        if (c == PAREN_CLOSE)
+        {
+            if (have_paren && !AT_END(string, end))
+            {
+                cConfig_error("unexpected '%c' after '%c'", *string, PAREN_CLOSE);
+                return 0;
+            }
+        }
+        else
+            *out++ = c;
+    }
+
+    *next = string;
+
+    if (!have_name)
+    {
+        line->name = NULL;
+        return 1;
+    }
+
+    *out = '\0';
+    line->value_len = out - line->value;
+    line->is_array = have_paren;
+
+    return 1;
+}
+
+/* Make an option of what parse_line found. If IS_MAPPED is non zero
+   the line lives in a mapping that outlives the option, so the name and
+   values are used as they are instead of being copied. */
+static cConfig_opt *
+line_opt(struct config_version *v, struct line *line, unsigned int is_mapped)
+{
+    cConfig_opt *opt;
+
+    opt = arena_alloc(v->arena, sizeof(cConfig_opt));
+
+    if (is_mapped)
+        opt->name = line->name;
+    else
+        opt->name = arena_dupstrn(v->arena, line->name, line->name_len);
+
+    opt->name_len = line->name_len;
+    opt->is_mapped = is_mapped;
+    opt->cache_type = CCONFIG_NONE;
+    opt->int_values = NULL;
+    opt->double_values = NULL;
+    opt->index = NULL;
+
+    if (line->is_array)
+    {
+        split_values(v, opt, line->value, line->value_len, is_mapped);
+
+        opt->value = NULL;
+        opt->value_len = 0;
+        opt->is_array = 1;
+    }
+    else
+    {
+        if (is_mapped)
+            opt->value = line->value;
+        else
+            opt->value = arena_dupstrn(v->arena, line->value, line->value_len);
+
+        opt->value_len = line->value_len;
+        opt->values = NULL;
+        opt->value_lens = NULL;
+        opt->is_array = 0;
+        opt->size = 1;
+    }
+
+    return opt;
+}
+
+/* Add the option found by parse_line, see line_opt. */
+static cConfig_opt *
+add_line(struct config_version *v, struct line *line, unsigned int is_mapped)
+{
+    return insert_opt(v, line_opt(v, line, is_mapped));
+}
+
+/* Parse every line between STRING and END, see parse_line for the
+   requirements on the buffer and FILTER. */
+static unsigned int
+parse_buffer(cConfig_ctx *ctx, struct config_version *v, char *string, char *end,
+             unsigned int is_mapped, const struct filter *filter)
+{
+    struct line line;
+    char *next, *start = string;
+    uint64_t lines = 0;
+    unsigned int parsed, ret = 1;
+
+    for (; string < end; ++lines)
+    {
+        /* Ignore lines that start with a comment character. */
+        if (*string == ctx->comment)
+        {
+            if ((next = memchr(string, '\n', end - string)) == NULL)
+            {
+                string = end;
+                lines++;
+                break;
+            }
+
+            string = next + 1;
+            continue;
+        }
+
+        PROFILE_START(PROFILE_PARSE_LINE);
+        parsed = parse_line(string, end, &next, &line, ctx->delim, filter);
+        PROFILE_END(PROFILE_PARSE_LINE);
+
+        if (!parsed)
+        {
+            ret = 0;
+            break;
+        }
+
+        if (line.name)
+            add_line(v, &line, is_mapped);
+
+        string = next;
+    }
+
+    __atomic_add_fetch(&ctx->load_bytes, string - start, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&ctx->load_lines, lines, __ATOMIC_RELAXED);
+
+    return ret;
+}
+
+static unsigned int
+load_file(cConfig_ctx *ctx, struct config_version *v, const char *filename)
+{
+    FILE *f;
+    char line[255];
+
+    if ((f = fopen(filename, "r")) == NULL)
+        return 0;
+        
+    while (fgets(line, 255, f) != NULL)
+    {
+        if (!parse_buffer(ctx, v, line, line + strlen(line), 0, NULL))
+        {
+            fclose(f);
+            return 0;
+        }
+    }
+    
+    fclose(f);
+    return 1;
+}
+
+/* Load FILENAME into the current table. This changes the table in
+   place, use cConfig_reload while other threads read. */
+unsigned int
+cConfig_ctx_load(cConfig_ctx *ctx, const char *filename)
+{
+    uint64_t start;
+    unsigned int ret;
+
+    PROFILE_START(PROFILE_LOAD);
+
+    pthread_mutex_lock(&ctx->write_lock);
+
+    if (is_read_only(ctx))
+    {
+        pthread_mutex_unlock(&ctx->write_lock);
+        return 0;
+    }
+
+    start = now_ns();
+    ret = load_file(ctx, ctx->current, filename);
+    publish(ctx, ctx->current);
+    count_load(ctx, start);
+
+    pthread_mutex_unlock(&ctx->write_lock);
+
+    PROFILE_END(PROFILE_LOAD);
+
+    return ret;
+}
+
+/* Load FILENAME into a new table and swap it in for the current one.
+   Readers keep using the old table until they are done with it, it is
+   freed by a later reload or by cConfig_free once they are. On failure
+   the current table is left alone. */
+unsigned int
+cConfig_ctx_reload(cConfig_ctx *ctx, const char *filename)
+{
+    struct config_version *v;
+    uint64_t start;
+
+    PROFILE_START(PROFILE_LOAD);
+
+    start = now_ns();
+    v = new_version();
+
+    if (!load_file(ctx, v, filename))
+    {
+        free_version(v);
+        return 0;
+    }
+
+    pthread_mutex_lock(&ctx->write_lock);
+
+    publish(ctx, v);
+    count_load(ctx, start);
+    replace_version(ctx, v);
+
+    pthread_mutex_unlock(&ctx->write_lock);
+
+    PROFILE_END(PROFILE_LOAD);
+
+    return 1;
+}
+
+/* Hand the option parse_line found to the callbacks of
+   cConfig_parse_stream, elements of an array one at a time. Returns 0
+   if a callback asked to stop. */
+static unsigned int
+stream_line(struct line *line, const cConfig_callbacks *cb, void *user)
+{
+    char *value, *end, *comma;
+    size_t index = 0;
+
+    if (!line->is_array)
+        return cb->on_opt == NULL
+               || cb->on_opt(user, line->name, line->name_len, line->value, line->value_len);
+
+    if (cb->on_array_elem == NULL)
+        return 1;
+
+    end = line->value + line->value_len;
+
+    /* Empty elements are skipped, the same as split_values does. */
+    for (value = line->value; value < end; value = comma + 1)
+    {
+        if ((comma = memchr(value, ',', end - value)) == NULL)
+            comma = end;
+
+        if (comma == value)
+            continue;
+
+        *comma = '\0';
+
+        if (!cb->on_array_elem(user, line->name, line->name_len, index++, value, comma - value))
+            return 0;
+    }
+
+    return 1;
+}
+
+/* The callbacks cConfig_parse_stream was given. */
+struct stream_callbacks
+{
+    const cConfig_callbacks *cb;
+    void *user;
+};
+
+/* Parse the lines between STRING and END like parse_buffer does, but
+   pass the options to the callbacks in ARG instead of adding them. */
+static unsigned int
+stream_lines(cConfig_ctx *ctx, char *string, char *end, void *arg)
+{
+    struct stream_callbacks *callbacks = arg;
+    struct line line;
+    char *next;
+
+    while (string < end)
+    {
+        if (*string == ctx->comment)
+        {
+            if ((next = memchr(string, '\n', end - string)) == NULL)
+                break;
+
+            string = next + 1;
+            continue;
+        }
+
+        if (!parse_line(string, end, &next, &line, ctx->delim, NULL))
+            return 0;
+
+        if (line.name && !stream_line(&line, callbacks->cb, callbacks->user))
+            return 0;
+
+        string = next;
+    }
+
+    return 1;
+}
+
+/* Add the options on the lines between STRING and END to the version
+   ARG, copying them out of the buffer. */
+static unsigned int
+load_lines(cConfig_ctx *ctx, char *string, char *end, void *arg)
+{
+    return parse_buffer(ctx, arg, string, end, 0, NULL);
+}
+
+/* Reads up to SIZE bytes of the input of parse_stream into BUF,
+   returns how many or -1 on error. */
+typedef ssize_t (*stream_read)(void *, char *, size_t);
+
+/* Parses complete lines for parse_stream, see stream_lines and
+   load_lines. */
+typedef unsigned int (*stream_parse)(cConfig_ctx *, char *, char *, void *);
+
+/* Read SRC with READER and hand the lines to PARSE along with ARG.
+   Complete lines are parsed as soon as they are in the buffer, which
+   only has to hold the longest line, so the input may be a pipe of any
+   size. */
+static unsigned int
+parse_stream(cConfig_ctx *ctx, stream_read reader, void *src, stream_parse parse, void *arg)
+{
+    char *buf, *end;
+    size_t size, len = 0;
+    ssize_t n;
+    unsigned int ret = 1, eof = 0;
+
+    size = STREAM_BUF_SIZE;
+
+    /* One more byte for parse_line to terminate a last line that has
+       no newline. */
+    buf = xmalloc(size + 1);
+
+    while (ret && !eof)
+    {
+        if ((n = reader(src, buf + len, size - len)) < 0)
+        {
+            ret = 0;
+            break;
+        }
+
+        eof = n == 0;
+        len += n;
+
+        /* Parse up to the last newline, or everything at the end. */
+        for (end = buf + len; !eof && end > buf && end[-1] != '\n'; --end)
+            ;
+
+        if (end == buf && !eof)
+        {
+            if (len == size)
+            {
+                size *= 2;
+                buf = xrealloc(buf, size + 1);
+            }
+
+            continue;
+        }
+
+        ret = parse(ctx, buf, end, arg);
+
+        len -= end - buf;
+        memmove(buf, end, len);
+    }
+
+    xfree(buf);
+
+    return ret;
+}
+
+static ssize_t
+read_file(void *src, char *buf, size_t size)
+{
+    size_t n;
+
+    n = fread(buf, 1, size, src);
+
+    return n == 0 && ferror((FILE *)src) ? -1 : (ssize_t)n;
+}
+
+static ssize_t
+read_fd(void *src, char *buf, size_t size)
+{
+    ssize_t n;
+
+    while ((n = read(*(int *)src, buf, size)) == -1 && errno == EINTR)
+        ;
+
+    return n;
+}
+
+/* What is left of the buffer passed to cConfig_parse_buffer. */
+struct stream_buffer
+{
+    const char *string;
+    size_t len;
+};
+
+static ssize_t
+read_buffer(void *src, char *buf, size_t size)
+{
+    struct stream_buffer *b = src;
+
+    if (size > b->len)
+        size = b->len;
+
+    memcpy(buf, b->string, size);
+    b->string += size;
+    b->len -= size;
+
+    return size;
+}
+
+/* Parse everything read from F and call the callbacks in CB with every
+   option, without building a table: ON_OPT with the name and value of
+   an option, ON_ARRAY_ELEM with the name, number and value of every
+   element of an array. Either may be NULL. Names and values are NUL
+   terminated and only valid during the call. A callback returns 0 to
+   stop. Memory used only depends on the longest line, F may be a pipe.
+   Returns non zero if all of F was parsed. */
+unsigned int
+cConfig_ctx_parse_stream(cConfig_ctx *ctx, FILE *f, const cConfig_callbacks *cb, void *user)
+{
+    struct stream_callbacks callbacks;
+
+    callbacks.cb = cb;
+    callbacks.user = user;
+
+    return parse_stream(ctx, read_file, f, stream_lines, &callbacks);
+}
+
+/* Same as cConfig_parse_stream for a file descriptor. */
+unsigned int
+cConfig_ctx_parse_fd(cConfig_ctx *ctx, int fd, const cConfig_callbacks *cb, void *user)
+{
+    struct stream_callbacks callbacks;
+
+    callbacks.cb = cb;
+    callbacks.user = user;
+
+    return parse_stream(ctx, read_fd, &fd, stream_lines, &callbacks);
+}
+
+/* Same as cConfig_parse_stream for the LEN bytes at STRING, which are
+   parsed a part at a time and left alone. */
+unsigned int
+cConfig_ctx_parse_buffer(cConfig_ctx *ctx, const char *string, size_t len,
+                         const cConfig_callbacks *cb, void *user)
+{
+    struct stream_callbacks callbacks;
+    struct stream_buffer b;
+
+    callbacks.cb = cb;
+    callbacks.user = user;
+    b.string = string;
+    b.len = len;
+
+    return parse_stream(ctx, read_buffer, &b, stream_lines, &callbacks);
+}
+
+/* Load everything read from FD into the current table. It is read a
+   large part at a time into a buffer that is reused, so it may be a
+   pipe or socket. Like cConfig_load this changes the table in place. */
+unsigned int
+cConfig_ctx_load_fd(cConfig_ctx *ctx, int fd)
+{
+    uint64_t start;
+    unsigned int ret;
+
+    PROFILE_START(PROFILE_LOAD);
+
+    pthread_mutex_lock(&ctx->write_lock);
+
+    if (is_read_only(ctx))
+    {
+        pthread_mutex_unlock(&ctx->write_lock);
+        return 0;
+    }
+
+    start = now_ns();
+    ret = parse_stream(ctx, read_fd, &fd, load_lines, ctx->current);
+    publish(ctx, ctx->current);
+    count_load(ctx, start);
+
+    pthread_mutex_unlock(&ctx->write_lock);
+
+    PROFILE_END(PROFILE_LOAD);
+
+    return ret;
+}
+
+/* Work shared by the threads of cConfig_ctx_load_many. */
+struct load_job
+{
+    cConfig_ctx *ctx;
+    const char **files;
+    size_t count;
+
+    /* Index of the next file to parse, taken atomically. */
+    size_t next;
+
+    /* What every file was parsed into. */
+    struct config_version **versions;
+    cConfig_load_status *status;
+};
+
+/* Number of threads to use when asked for THREADS, one per CPU if
+   THREADS isn't positive. */
+static size_t
+thread_count(int threads)
+{
+    long n;
+
+    if (threads > 0)
+        return threads;
+
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? n : 1;
+}
+
+/* Parse files into a version of their own until there are none left. */
+static void *
+load_worker(void *arg)
+{
+    struct load_job *job = arg;
+    struct config_version *v;
+    uint64_t start;
+    size_t i;
+
+    while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->count)
+    {
+        start = now_ns();
+
+        v = new_version();
+
+        job->status[i].ok = load_file(job->ctx, v, job->files[i]);
+        job->status[i].options = v->table->count;
+        job->status[i].parse_ns = now_ns() - start;
+        job->versions[i] = v;
+    }
+
+    return NULL;
+}
+
+static void
+merge_node(Hash_node *node, void *arg)
+{
+    insert_opt(arg, node->data);
+}
+
+/* Add every option of SRC to DST, replacing options with the same
+   name, and free SRC. The options themselves aren't copied, the arena
+   and mappings of SRC are handed over to DST. */
+static void
+merge_version(struct config_version *dst, struct config_version *src)
+{
+    struct mapping *map;
+
+    walk_hash_table(src->table, merge_node, dst);
+
+    if ((map = src->mappings) != NULL)
+    {
+        while (map->next)
+            map = map->next;
+
+        map->next = dst->mappings;
+        dst->mappings = src->mappings;
+    }
+
+    arena_merge(dst->arena, src->arena);
+    free_hash_table(src->table);
+    pthread_mutex_destroy(&src->lock);
+    xfree(src);
+}
+
+/* Load COUNT files on THREADS threads, or one per CPU if THREADS isn't
+   positive. Every file is parsed into a table of its own, which are
+   then merged in the order given, so an option defined in more than one
+   file gets its value from the last, the same as calling cConfig_load
+   on every file in turn. If STATUS is not NULL it receives what
+   happened to every file. Returns non zero if every file loaded. */
+unsigned int
+cConfig_ctx_load_many(cConfig_ctx *ctx, const char **files, size_t count, int threads,
+                      cConfig_load_status *status)
+{
+    struct load_job job;
+    pthread_t *workers;
+    size_t i, nthreads, started;
+    uint64_t start;
+    unsigned int ret = 1;
+
+    if (count == 0)
+        return 1;
+
+    PROFILE_START(PROFILE_LOAD);
+
+    start = now_ns();
+
+    if ((nthreads = thread_count(threads)) > count)
+        nthreads = count;
+
+    job.ctx = ctx;
+    job.files = files;
+    job.count = count;
+    job.next = 0;
+    job.versions = xcalloc(count, sizeof(struct config_version *));
+    job.status = status ? status : xcalloc(count, sizeof(cConfig_load_status));
+
+    workers = xcalloc(nthreads, sizeof(pthread_t));
+    started = 0;
+
+    /* The calling thread is one of the workers. */
+    for (i = 1; i < nthreads; ++i)
+        if (pthread_create(&workers[started], NULL, load_worker, &job) == 0)
+            started++;
+
+    load_worker(&job);
+
+    for (i = 0; i < started; ++i)
+        pthread_join(workers[i], NULL);
+
+    pthread_mutex_lock(&ctx->write_lock);
+
+    if (is_read_only(ctx))
+    {
+        for (i = 0; i < count; ++i)
+            free_version(job.versions[i]);
+
+        ret = 0;
+    }
+    else
+    {
+        for (i = 0; i < count; ++i)
+        {
+            ret &= job.status[i].ok;
+            merge_version(ctx->current, job.versions[i]);
+        }
+
+        publish(ctx, ctx->current);
+        count_load(ctx, start);
+    }
+
+    pthread_mutex_unlock(&ctx->write_lock);
+
+    if (status == NULL)
+        xfree(job.status);
+
+    xfree(job.versions);
+    xfree(workers);
+
+    PROFILE_END(PROFILE_LOAD);
+
+    return ret;
+}
+
+/* Keep track of memory that mapped options point into. */
+static void
+add_mapping(struct config_version *v, void *addr, size_t len)
+{
+    struct mapping *map;
+
+    map = arena_alloc(v->arena, sizeof(struct mapping));
+
+    map->addr = addr;
+    map->len = len;
+    map->next = v->mappings;
+
+    v->mappings = map;
+}
+
+/* A file mapped by map_file. */
+struct mapped_file
+{
+    /* The lines to parse, each one ends in a newline. */
+    char *string;
+    char *end;
+
+    /* Copy of the last line if the file doesn't end in a newline,
+       parse_line needs a byte past the line to terminate it. */
+    char *tail;
+    size_t tail_len;
+};
+
+/* Map FILENAME into memory, writable but private, for as long as V
+   is around. */
+static unsigned int
+map_file(struct config_version *v, const char *filename, struct mapped_file *file)
+{
+    struct stat st;
+    char *string, *end, *start;
+    int fd;
+
+    file->string = file->end = file->tail = NULL;
+    file->tail_len = 0;
+
+    if ((fd = open(filename, O_RDONLY)) == -1)
+        return 0;
+
+    if (fstat(fd, &st) == -1)
+    {
+        close(fd);
+        return 0;
+    }
+
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return 1;
+    }
+
+    string = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (string == MAP_FAILED)
+        return 0;
+
+    madvise(string, st.st_size, MADV_SEQUENTIAL);
+    add_mapping(v, string, st.st_size);
+
+    end = string + st.st_size;
+
+    if (end[-1] != '\n')
+    {
+        for (start = end; start > string && start[-1] != '\n'; --start)
+            ;
+
+        file->tail_len = end - start;
+        file->tail = arena_alloc(v->arena, file->tail_len + 1);
+        memcpy(file->tail, start, file->tail_len);
+
+        end = start;
+    }
+
+    file->string = string;
+    file->end = end;
+
+    return 1;
+}
+
+/* Parse a file mapped by map_file into V, keeping the options FILTER
+   matches if it isn't NULL. */
+static unsigned int
+parse_mapped_file(cConfig_ctx *ctx, struct config_version *v, struct mapped_file *file,
+                  const struct filter *filter)
+{
+    if (!parse_buffer(ctx, v, file->string, file->end, 1, filter))
+        return 0;
+
+    if (file->tail && !parse_buffer(ctx, v, file->tail, file->tail + file->tail_len, 1, filter))
+        return 0;
+
+    return 1;
+}
+
+static unsigned int
+load_mmap(cConfig_ctx *ctx, struct config_version *v, const char *filename)
+{
+    struct mapped_file file;
+
+    if (!map_file(v, filename, &file))
+        return 0;
+
+    return parse_mapped_file(ctx, v, &file, NULL);
+}
+
+/* A part of a file parsed by one thread of load_parallel. */
+struct parse_chunk
+{
+    cConfig_ctx *ctx;
+    struct config_version *v;
+    char *start;
+    char *end;
+    unsigned int ok;
+};
+
+static void *
+parse_worker(void *arg)
+{
+    struct parse_chunk *chunk = arg;
+
+    chunk->ok = parse_buffer(chunk->ctx, chunk->v, chunk->start, chunk->end, 1, NULL);
+
+    return NULL;
+}
+
+/* Map FILENAME and split it at newlines into a chunk per thread. Every
+   chunk is parsed by a thread of its own, the first into V and the rest
+   into versions of their own, which are merged into V in file order.
+   Options that appear more than once keep the last value and parsing
+   stops at the first error, the same as load_mmap. */
+static unsigned int
+load_parallel(cConfig_ctx *ctx, struct config_version *v, const char *filename, int threads)
+{
+    struct mapped_file file;
+    struct parse_chunk *chunks;
+    pthread_t *workers;
+    unsigned int *started;
+    char *start, *split, *nl;
+    size_t i, count, size, options;
+    unsigned int ret = 1;
+
+    if (!map_file(v, filename, &file))
+        return 0;
+
+    size = file.end - file.string;
+
+    /* Don't bother with threads for small files. */
+    count = thread_count(threads);
+
+    if (count > size / PARALLEL_MIN_CHUNK)
+        count = size / PARALLEL_MIN_CHUNK;
+
+    if (count <= 1)
+        return parse_mapped_file(ctx, v, &file, NULL);
+
+    chunks = xcalloc(count, sizeof(struct parse_chunk));
+    workers = xcalloc(count, sizeof(pthread_t));
+    started = xcalloc(count, sizeof(unsigned int));
+
+    start = file.string;
+
+    for (i = 0; i < count; ++i)
+    {
+        chunks[i].ctx = ctx;
+        chunks[i].v = i == 0 ? v : new_version();
+        chunks[i].start = start;
+
+        /* Every chunk but the last ends after the first newline past
+           its share of the file. */
+        split = file.string + size / count * (i + 1);
+
+        if (i == count - 1 || split >= file.end)
+            chunks[i].end = file.end;
+        else
+        {
+            if (split < start)
+                split = start;
+
+            nl = memchr(split, '\n', file.end - split);
+            chunks[i].end = nl ? nl + 1 : file.end;
+        }
+
+        start = chunks[i].end;
+    }
+
+    for (i = 1; i < count; ++i)
+        started[i] = pthread_create(&workers[i], NULL, parse_worker, &chunks[i]) == 0;
+
+    parse_worker(&chunks[0]);
+
+    for (i = 1; i < count; ++i)
+    {
+        if (started[i])
+            pthread_join(workers[i], NULL);
+        else
+            parse_worker(&chunks[i]);
+    }
+
+    /* Grow the table once instead of while merging. */
+    for (options = 0, i = 0; i < count; ++i)
+        options += chunks[i].v->table->count;
+
+    if (options > v->table->size)
+        resize_hash_table(options, &v->table);
+
+    for (i = 0; i < count; ++i)
+    {
+        if (i > 0 && ret)
+            merge_version(v, chunks[i].v);
+        else
+        if (i > 0)
+            free_version(chunks[i].v);
+
+        ret &= chunks[i].ok;
+    }
+
+    xfree(started);
+    xfree(workers);
+    xfree(chunks);
+
+    if (ret && file.tail)
+        ret = parse_buffer(ctx, v, file.tail, file.tail + file.tail_len, 1, NULL);
+
+    return ret;
+}
+
+/* Load a configuration file by mapping it into memory and parsing it
+   in place. Option names and values point straight into the (private)
+   mapping instead of being copied, which stays mapped until the table
+   is freed. */
+unsigned int
+cConfig_ctx_load_mmap(cConfig_ctx *ctx, const char *filename)
+{
+    uint64_t start;
+    unsigned int ret;
+
+    PROFILE_START(PROFILE_LOAD);
+
+    pthread_mutex_lock(&ctx->write_lock);
+
+    if (is_read_only(ctx))
+    {
+        pthread_mutex_unlock(&ctx->write_lock);
+        return 0;
+    }
+
+    start = now_ns();
+    ret = load_mmap(ctx, ctx->current, filename);
+    publish(ctx, ctx->current);
+    count_load(ctx, start);
+
+    pthread_mutex_unlock(&ctx->write_lock);
+
+    PROFILE_END(PROFILE_LOAD);
+
+    return ret;
+}
+
+/* Load the LEN bytes at STRING into the current table. STRING is left
+   alone: it is copied once into memory the table owns and parsed there
+   in place, the way cConfig_load_mmap parses a file. */
+unsigned int
+cConfig_ctx_load_buffer(cConfig_ctx *ctx, const char *string, size_t len)
+{
+    struct config_version *v;
+    uint64_t start;
+    char *copy;
+    unsigned int ret = 1;
+
+    PROFILE_START(PROFILE_LOAD);
+
+    pthread_mutex_lock(&ctx->write_lock);
+
+    if (is_read_only(ctx))
+    {
+        pthread_mutex_unlock(&ctx->write_lock);
+        return 0;
+    }
+
+    start = now_ns();
+    v = ctx->current;
+
+    if (len > 0)
+    {
+        /* One more byte for parse_line to terminate the last line. */
+        copy = mmap(NULL, len + 1, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (copy == MAP_FAILED)
+            ret = 0;
+        else
+        {
+            add_mapping(v, copy, len + 1);
+            memcpy(copy, string, len);
+
+            ret = parse_buffer(ctx, v, copy, copy + len, 1, NULL);
+        }
+    }
+
+    publish(ctx, v);
+    count_load(ctx, start);
+
+    pthread_mutex_unlock(&ctx->write_lock);
+
+    PROFILE_END(PROFILE_LOAD);
+
+    return ret;
+}
+
+/* Same as cConfig_load_mmap, but large files are split up and parsed
+   on THREADS threads, or one per CPU if THREADS isn't positive. */
+unsigned int
+cConfig_ctx_load_parallel(cConfig_ctx *ctx, const char *filename, int threads)
+{
+    uint64_t start;
+    unsigned int ret;
+
+    PROFILE_START(PROFILE_LOAD);
+
+    pthread_mutex_lock(&ctx->write_lock);
+
+    if (is_read_only(ctx))
+    {
+        pthread_mutex_unlock(&ctx->write_lock);
+        return 0;
+    }
+
+    start = now_ns();
+    ret = load_parallel(ctx, ctx->current, filename, threads);
+    publish(ctx, ctx->current);
+    count_load(ctx, start);
+
+    pthread_mutex_unlock(&ctx->write_lock);
+
+    PROFILE_END(PROFILE_LOAD);
+
+    return ret;
+}
+
+/* Same as cConfig_load_mmap, but only options with a name that starts
+   with one of the COUNT PREFIXES are loaded. Other lines are skipped
+   once their name has been read, their values aren't looked at and the
+   pages they are on aren't copied. */
+unsigned int
+cConfig_ctx_load_filtered(cConfig_ctx *ctx, const char *filename, const char **prefixes,
+                          size_t count)
+{
+    struct mapped_file file;
+    struct filter filter;
+    uint64_t start;
+    unsigned int ret;
+    size_t i;
+
+    PROFILE_START(PROFILE_LOAD);
+
+    filter.prefixes = prefixes;
+    filter.count = count;
+    filter.lens = xcalloc(count + 1, sizeof(size_t));
+
+    for (i = 0; i < count; ++i)
+        filter.lens[i] = strlen(prefixes[i]);
+
+    pthread_mutex_lock(&ctx->write_lock);
+
+    if (is_read_only(ctx))
+        ret = 0;
+    else
+    {
+        start = now_ns();
+
+        ret = map_file(ctx->current, filename, &file)
+              && parse_mapped_file(ctx, ctx->current, &file, &filter);
+
+        publish(ctx, ctx->current);
+        count_load(ctx, start);
+    }
+
+    pthread_mutex_unlock(&ctx->write_lock);
+
+    xfree(filter.lens);
+
+    PROFILE_END(PROFILE_LOAD);
+
+    return ret;
+}
+
+/* Non zero if the LEN bytes at RAW, leaving out spaces the way
+   parse_line does, are the NAME_LEN bytes at NAME. */
+static unsigned int
+lazy_name_eq(const char *raw, size_t len, const char *name, size_t name_len)
+{
+    const char *end = raw + len, *name_end = name + name_len;
+
+    for (; raw < end; ++raw)
+    {
+        if (*raw == ' ')
+            continue;
+
+        if (name == name_end || *raw != *name++)
+            return 0;
+    }
+
+    return name == name_end;
+}
+
+/* The option in slot I of the lazily loaded file of V, parsed from a
+   copy of its line the first time it is asked for. NULL if the line
+   doesn't parse. */
+static cConfig_opt *
+lazy_opt(struct config_version *v, size_t i)
+{
+    struct lazy *l = v->lazy;
+    struct line line;
+    cConfig_opt *opt;
+    const char *start, *eol;
+    char *buf, *next;
+    size_t len;
+
+    if ((opt = __atomic_load_n(&l->opts[i], __ATOMIC_ACQUIRE)) != NULL)
+        return opt;
+
+    /* The arena isn't thread safe, see get_typed_array. */
+    pthread_mutex_lock(&v->lock);
+
+    if ((opt = l->opts[i]) == NULL)
+    {
+        start = l->base + l->slots[i].name - 1;
+
+        if ((eol = memchr(start, '\n', l->end - start)) == NULL)
+            eol = l->end;
+
+        /* parse_line needs a byte past the line to terminate it. */
+        len = eol - start;
+        buf = arena_alloc(v->arena, len + 1);
+        memcpy(buf, start, len);
+
+        if (parse_line(buf, buf + len, &next, &line, l->delim, NULL) && line.name)
+        {
+            opt = line_opt(v, &line, 1);
+
+            /* Those of an option the table hides aren't counted. */
+            if (opt->is_array && find_hash_node(opt->name, v->table) == NULL)
+                __atomic_add_fetch(&v->elem_count, opt->size, __ATOMIC_RELAXED);
+
+            __atomic_store_n(&l->opts[i], opt, __ATOMIC_RELEASE);
+        }
+    }
+
+    pthread_mutex_unlock(&v->lock);
+
+    return opt;
+}
+
+/* The slot of option NAME in the lazily loaded file of V, HASH is its
+   hash_key. (size_t)-1 if it isn't there. */
+static size_t
+lazy_find(struct config_version *v, const char *name, uint64_t hash)
+{
+    struct lazy *l = v->lazy;
+    struct lazy_slot *slot;
+    size_t i, len = (size_t)-1;
+
+    for (i = hash & l->mask; (slot = &l->slots[i])->name; i = (i + 1) & l->mask)
+    {
+        if (slot->hash != (uint32_t)(hash >> 32))
+            continue;
+
+        if (len == (size_t)-1)
+            len = strlen(name);
+
+        if (lazy_name_eq(l->base + slot->name - 1, slot->len, name, len))
+            return i;
+    }
+
+    return (size_t)-1;
+}
+
+static cConfig_opt *
+lazy_lookup(struct config_version *v, const char *name, uint64_t hash)
+{
+    size_t i;
+
+    if ((i = lazy_find(v, name, hash)) == (size_t)-1)
+        return NULL;
+
+    return lazy_opt(v, i);
+}
+
+/* Put the LEN bytes at NAME in the index of L, a name that is already
+   there moves to the later line. Returns non zero if it wasn't. */
+static unsigned int
+add_lazy_name(struct lazy *l, const char *name, size_t len)
+{
+    struct lazy_slot *slot;
+    const char *key = name;
+    char *compact = NULL;
+    size_t i, key_len = len;
+    uint64_t hash;
+    unsigned int added;
+
+    /* Spaces aren't part of the name, hash it without them. */
+    if (memchr(name, ' ', len))
+    {
+        compact = xmalloc(len);
+
+        for (i = key_len = 0; i < len; ++i)
+            if (name[i] != ' ')
+                compact[key_len++] = name[i];
+
+        key = compact;
+    }
+
+    hash = hash_string(key, key_len);
+
+    for (i = hash & l->mask; (slot = &l->slots[i])->name; i = (i + 1) & l->mask)
+        if (slot->hash == (uint32_t)(hash >> 32)
+            && lazy_name_eq(l->base + slot->name - 1, slot->len, key, key_len))
+            break;
+
+    added = slot->name == 0;
+
+    slot->name = name - l->base + 1;
+    slot->len = len;
+    slot->hash = hash >> 32;
+
+    xfree(compact);
+
+    return added;
+}
+
+/* Map FILENAME into V and index where its options are. Lines are only
+   looked at up to the delimiter, the way parse_buffer would see them:
+   comments are skipped and the name is what comes before the first
+   delimiter, less the spaces. */
+static unsigned int
+map_lazy(cConfig_ctx *ctx, struct config_version *v, const char *filename)
+{
+    struct lazy *l;
+    struct stat st;
+    const char *string, *eol, *delim, *name, *name_end;
+    char *base = NULL;
+    size_t lines = 1, size;
+    int fd;
+
+    if ((fd = open(filename, O_RDONLY)) == -1)
+        return 0;
+
+    if (fstat(fd, &st) == -1)
+    {
+        close(fd);
+        return 0;
+    }
+
+    if (st.st_size > 0)
+    {
+        base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (base == MAP_FAILED)
+        {
+            close(fd);
+            return 0;
+        }
+
+        madvise(base, st.st_size, MADV_SEQUENTIAL);
+        add_mapping(v, base, st.st_size);
+    }
+
+    close(fd);
+
+    l = arena_alloc(v->arena, sizeof(struct lazy));
+
+    l->base = base;
+    l->end = base + st.st_size;
+    l->delim = ctx->delim;
+
+    for (string = l->base; string < l->end; ++string, ++lines)
+        if ((string = memchr(string, '\n', l->end - string)) == NULL)
+            break;
+
+    /* Keep the index at most three quarters full. */
+    for (size = 1; size < lines + lines / 3; size <<= 1)
+        ;
+
+    l->slots = xcalloc(size, sizeof(struct lazy_slot));
+    l->opts = xcalloc(size, sizeof(cConfig_opt *));
+    l->mask = size - 1;
+
+    for (string = l->base; string < l->end; string = eol + 1)
+    {
+        if ((eol = memchr(string, '\n', l->end - string)) == NULL)
+            eol = l->end;
+
+        if (*string == ctx->comment || (delim = memchr(string, l->delim, eol - string)) == NULL)
+            continue;
+
+        for (name = string; name < delim && *name == ' '; ++name)
+            ;
+
+        for (name_end = delim; name_end > name && name_end[-1] == ' '; --name_end)
+            ;
+
+        v->opt_count += add_lazy_name(l, name, name_end - name);
+    }
+
+    if (base)
+        madvise(base, st.st_size, MADV_RANDOM);
+
+    v->lazy = l;
+
+    return 1;
+}
+
+/* Replace the table with FILENAME without parsing it. Loading only
+   notes where every option is, an option is parsed the first time it
+   is looked up and kept from then on, so a process pays for the
+   options it uses. The file stays mapped until the table is freed.
+   Errors in a line are only found when its option is first looked up,
+   which then finds nothing. Like cConfig_reload, other threads may
+   keep reading while this runs. */
+unsigned int
+cConfig_ctx_load_lazy(cConfig_ctx *ctx, const char *filename)
+{
+    struct config_version *v;
+    uint64_t start;
+
+    PROFILE_START(PROFILE_LOAD);
+
+    start = now_ns();
+    v = new_version();
+
+    if (!map_lazy(ctx, v, filename))
+    {
+        free_version(v);
+        return 0;
+    }
+
+    pthread_mutex_lock(&ctx->write_lock);
+
+    publish(ctx, v);
+    count_load(ctx, start);
+    replace_version(ctx, v);
+
+    pthread_mutex_unlock(&ctx->write_lock);
+
+    PROFILE_END(PROFILE_LOAD);
+
+    return 1;
+}
+
+/* What walk_version calls for every option, with its hash_key. */
+typedef void (*opt_walker)(cConfig_opt *, uint64_t, void *);
+
+struct version_walk
+{
+    opt_walker fn;
+    void *arg;
+};
+
+static void
+walk_table_node(Hash_node *node, void *arg)
+{
+    struct version_walk *walk = arg;
+
+    walk->fn(node->data, node->hash, walk->arg);
+}
+
+/* Number of options walk_version calls FN with at most. */
+static size_t
+version_size(struct config_version *v)
+{
+    if (v->frozen)
+        return v->frozen->count;
+
+    return v->table->count + (v->snapshot ? v->snapshot->count : 0)
+           + (v->lazy ? v->lazy->mask + 1 : 0);
+}
+
+/* Call FN with every option a lookup in V can find: those in the
+   table and those in its snapshot or lazily loaded file that the table
+   doesn't hide, which for the latter means parsing them. Called with
+   write_lock held. */
+static void
+walk_version(struct config_version *v, opt_walker fn, void *arg)
+{
+    struct version_walk walk;
+    struct snapshot *s = v->snapshot;
+    cConfig_opt *opt;
+    uint64_t hash;
+    size_t i;
+
+    if (v->frozen)
+    {
+        for (i = 0; i < v->frozen->count; ++i)
+            fn(&v->frozen->opts[i], v->frozen->hashes[i], arg);
+
+        return;
+    }
+
+    walk.fn = fn;
+    walk.arg = arg;
+    walk_hash_table(v->table, walk_table_node, &walk);
+
+    for (i = 0; s && i <= s->mask; ++i)
+    {
+        if (s->slots[i].opt == 0)
+            continue;
+
+        if (find_hash_node_hashed(s->base + s->slots[i].name, s->slots[i].hash, v->table) == NULL)
+            fn(snapshot_opt(s, s->slots[i].opt - 1), s->slots[i].hash, arg);
+    }
+
+    for (i = 0; v->lazy && i <= v->lazy->mask; ++i)
+    {
+        if (v->lazy->slots[i].name == 0 || (opt = lazy_opt(v, i)) == NULL)
+            continue;
+
+        hash = hash_key(opt->name);
+
+        if (find_hash_node_hashed(opt->name, hash, v->table) == NULL)
+            fn(opt, hash, arg);
+    }
+}
+
+/* Hash the contents of the file at PATH, and store its size and
+   modification time in HEADER. */
+static unsigned int
+hash_source(const char *path, struct snapshot_header *header)
+{
+    struct stat st;
+    void *data;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) == -1)
+        return 0;
+
+    if (fstat(fd, &st) == -1)
+    {
+        close(fd);
+        return 0;
+    }
+
+    header->src_size = st.st_size;
+    header->src_mtime_sec = st.st_mtim.tv_sec;
+    header->src_mtime_nsec = st.st_mtim.tv_nsec;
+    header->src_hash = hash_string("", 0);
+
+    if (st.st_size > 0)
+    {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            return 0;
+        }
+
+        header->src_hash = hash_string(data, st.st_size);
+        munmap(data, st.st_size);
+    }
+
+    close(fd);
+    return 1;
+}
+
+/* A snapshot being written by cConfig_compile. */
+struct image
+{
+    char *base;
+
+    /* Where the next string goes. */
+    size_t used;
+
+    /* Strings already in the image, so every one is stored once. */
+    Hash_table *pool;
+    Arena *arena;
+
+    /* The options, in the order they are written. */
+    cConfig_opt **opts;
+    size_t count;
+};
+
+static void
+collect_opt(cConfig_opt *opt, uint64_t hash, void *arg)
+{
+    struct image *image = arg;
+
+    (void)hash;
+    image->opts[image->count++] = opt;
+}
+
+/* Offset of STRING in the string pool of IMAGE, added if needed. */
+static uint64_t
+pool_string(struct image *image, const char *string, size_t len)
+{
+    Hash_node *node;
+    uint64_t offset;
+
+    if ((node = find_hash_node(string, image->pool)) != NULL)
+        return (uintptr_t)node->data;
+
+    offset = image->used;
+
+    memcpy(image->base + offset, string, len + 1);
+    image->used += len + 1;
+
+    insert_hash_node(string, (void *)(uintptr_t)offset, image->pool);
+
+    return offset;
+}
+
+#define ALIGN8(n) (((n) + 7) & ~(size_t)7)
+
+/* Write the options collected in IMAGE where HEADER says they go and
+   return the size of the snapshot. */
+static size_t
+write_image(struct image *image, struct snapshot_header *header)
+{
+    struct snapshot_slot *slots, *slot;
+    cConfig_opt *opt, rec;
+    uint64_t *values, *lens;
+    size_t i, j, arrays;
+    uint64_t h;
+
+    slots = (struct snapshot_slot *)(image->base + header->slots);
+    arrays = header->slots + header->slot_count * sizeof(struct snapshot_slot);
+
+    for (i = 0; i < image->count; ++i)
+    {
+        opt = image->opts[i];
+
+        memset(&rec, 0, sizeof(rec));
+
+        rec.name = (char *)(uintptr_t)pool_string(image, opt->name, opt->name_len);
+        rec.name_len = opt->name_len;
+        rec.is_array = opt->is_array;
+        rec.is_mapped = 1;
+        rec.size = opt->size;
+        rec.cache_type = CCONFIG_NONE;
+
+        if (opt->is_array)
+        {
+            if (opt->size > 0)
+            {
+                values = (uint64_t *)(image->base + arrays);
+                lens = values + opt->size;
+
+                rec.values = (char **)(uintptr_t)arrays;
+                rec.value_lens = (size_t *)(uintptr_t)(arrays + opt->size * sizeof(uint64_t));
+
+                for (j = 0; j < opt->size; ++j)
+                {
+                    values[j] = pool_string(image, opt->values[j], opt->value_lens[j]);
+                    lens[j] = opt->value_lens[j];
+                }
+
+                arrays += 2 * opt->size * sizeof(uint64_t);
+            }
+        }
+        else
+        {
+            rec.value = (char *)(uintptr_t)pool_string(image, opt->value, opt->value_len);
+            rec.value_len = opt->value_len;
+        }
+
+        memcpy(image->base + header->opts + i * sizeof(cConfig_opt), &rec, sizeof(rec));
+
+        h = hash_string(opt->name, opt->name_len);
+        slot = &slots[h & (header->slot_count - 1)];
+
+        while (slot->opt)
+            if (++slot == slots + header->slot_count)
+                slot = slots;
+
+        slot->hash = h;
+        slot->name = (uintptr_t)rec.name;
+        slot->opt = i + 1;
+    }
+
+    return image->used;
+}
+
+/* Lay out every option of V as a snapshot, HEADER already holds what
+   is known about its source. Returns the snapshot, HEADER->size bytes
+   from xmalloc. Called with write_lock held if V is current. */
+static char *
+build_image(struct config_version *v, struct snapshot_header *header)
+{
+    struct image image;
+    size_t i, j, size, strings, arrays;
+
+    image.count = 0;
+    image.opts = xcalloc(version_size(v) + 1, sizeof(cConfig_opt *));
+
+    walk_version(v, collect_opt, &image);
+
+    /* Room for every string without sharing any, the snapshot ends
+       where the strings that were written do. */
+    strings = arrays = 0;
+    header->elems = 0;
+
+    for (i = 0; i < image.count; ++i)
+    {
+        strings += image.opts[i]->name_len + 1;
+
+        if (image.opts[i]->is_array)
+        {
+            arrays += 2 * image.opts[i]->size * sizeof(uint64_t);
+            header->elems += image.opts[i]->size;
+
+            for (j = 0; j < image.opts[i]->size; ++j)
+                strings += image.opts[i]->value_lens[j] + 1;
+        }
+        else
+            strings += image.opts[i]->value_len + 1;
+    }
+
+    memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic));
+    header->version = SNAPSHOT_VERSION;
+    header->byte_order = SNAPSHOT_BYTE_ORDER;
+    header->ptr_size = sizeof(void *);
+    header->opt_size = sizeof(cConfig_opt);
+    header->hash_fn = CCONFIG_HASH_FN;
+    header->count = image.count;
+
+    for (header->slot_count = 1; header->slot_count < image.count * 2; header->slot_count <<= 1)
+        ;
+
+    header->opts = ALIGN8(sizeof(*header));
+    header->states = ALIGN8(header->opts + image.count * sizeof(cConfig_opt));
+    header->slots = ALIGN8(header->states + image.count * sizeof(uint32_t));
+
+    size = header->slots + header->slot_count * sizeof(struct snapshot_slot) + arrays;
+
+    image.base = xcalloc(1, size + strings);
+    image.used = size;
+    image.arena = new_arena(ARENA_SIZE);
+    image.pool = new_hash_table(TABLE_SIZE);
+    image.pool->arena = image.arena;
+
+    header->size = write_image(&image, header);
+    header->checksum = hash_string(image.base + sizeof(*header), header->size - sizeof(*header));
+    header->header_checksum = hash_string((char *)header, offsetof(struct snapshot_header, header_checksum));
+
+    memcpy(image.base, header, sizeof(*header));
+
+    free_hash_table(image.pool);
+    free_arena(image.arena);
+    xfree(image.opts);
+
+    return image.base;
+}
+
+/* Parse SOURCE and write its options to PATH as a snapshot that
+   cConfig_load_snapshot can map without parsing. The snapshot is
+   written to PATH.tmp first and renamed, so a process loading PATH
+   never sees half of it. */
+unsigned int
+cConfig_ctx_compile(cConfig_ctx *ctx, const char *source, const char *path)
+{
+    struct config_version *v;
+    struct snapshot_header header;
+    size_t done;
+    ssize_t n;
+    char *base, *tmp;
+    int fd;
+    unsigned int ret = 0;
+
+    memset(&header, 0, sizeof(header));
+
+    if (!hash_source(source, &header))
+        return 0;
+
+    v = new_version();
+
+    if (!load_mmap(ctx, v, source))
+    {
+        free_version(v);
+        return 0;
+    }
+
+    base = build_image(v, &header);
+
+    tmp = xmalloc(strlen(path) + sizeof(".tmp"));
+    sprintf(tmp, "%s.tmp", path);
+
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) != -1)
+    {
+        for (done = 0; done < header.size; done += n)
+            if ((n = write(fd, base + done, header.size - done)) <= 0)
+                break;
+
+        ret = close(fd) == 0 && done == header.size;
+        ret = ret && rename(tmp, path) == 0;
+
+        if (!ret)
+            unlink(tmp);
+    }
+
+    xfree(tmp);
+    xfree(base);
+    free_version(v);
+
+    return ret;
+}
+
+/* Non zero if SIZE bytes at BASE hold a snapshot this build can use. */
+static unsigned int
+check_snapshot(const char *base, size_t size)
+{
+    const struct snapshot_header *header = (const struct snapshot_header *)base;
+
+    if (size < sizeof(struct snapshot_header) ||
+        memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != SNAPSHOT_VERSION ||
+        header->byte_order != SNAPSHOT_BYTE_ORDER ||
+        header->ptr_size != sizeof(void *) ||
+        header->opt_size != sizeof(cConfig_opt) ||
+        header->hash_fn != CCONFIG_HASH_FN ||
+        header->size != size)
+        return 0;
+
+    if (header->header_checksum != hash_string(base, offsetof(struct snapshot_header, header_checksum)))
+        return 0;
+
+    /* What the header points at has to be inside the snapshot. */
+    if (header->slot_count == 0 || (header->slot_count & (header->slot_count - 1)) ||
+        header->count >= header->slot_count ||
+        header->opts + header->count * sizeof(cConfig_opt) > size ||
+        header->states + header->count * sizeof(uint32_t) > size ||
+        header->slots + header->slot_count * sizeof(struct snapshot_slot) > size)
+        return 0;
+
+    return header->checksum == hash_string(base + sizeof(*header), size - sizeof(*header));
+}
+
+/* Non zero if the snapshot described by HEADER was compiled from what
+   is in SOURCE now. If only the modification time changed the contents
+   are compared by hash. A missing SOURCE leaves only the snapshot. */
+static unsigned int
+snapshot_fresh(const struct snapshot_header *header, const char *source)
+{
+    struct snapshot_header now;
+    struct stat st;
+
+    if (source == NULL || stat(source, &st) == -1)
+        return 1;
+
+    if ((uint64_t)st.st_size != header->src_size)
+        return 0;
+
+    if (st.st_mtim.tv_sec == header->src_mtime_sec && st.st_mtim.tv_nsec == header->src_mtime_nsec)
+        return 1;
+
+    return hash_source(source, &now) && now.src_hash == header->src_hash;
+}
+
+/* Map the snapshot open on FD into V, if it is valid and up to date
+   with SOURCE. FD is closed. */
+static unsigned int
+map_snapshot_fd(struct config_version *v, int fd, const char *source)
+{
+    struct snapshot_header *header;
+    struct snapshot *s;
+    struct stat st;
+    char *base;
+
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(struct snapshot_header))
+    {
+        close(fd);
+        return 0;
+    }
+
+    base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED)
+        return 0;
+
+    header = (struct snapshot_header *)base;
+
+    if (!check_snapshot(base, st.st_size) || !snapshot_fresh(header, source))
+    {
+        munmap(base, st.st_size);
+        return 0;
+    }
+
+    madvise(base, st.st_size, MADV_RANDOM);
+    add_mapping(v, base, st.st_size);
+
+    s = arena_alloc(v->arena, sizeof(struct snapshot));
+
+    s->base = base;
+    s->opts = (cConfig_opt *)(base + header->opts);
+    s->states = (uint32_t *)(base + header->states);
+    s->slots = (struct snapshot_slot *)(base + header->slots);
+    s->mask = header->slot_count - 1;
+    s->count = header->count;
+    s->dev = st.st_dev;
+    s->ino = st.st_ino;
+
+    v->snapshot = s;
+    v->opt_count = header->count;
+    v->elem_count = header->elems;
+
+    return 1;
+}
+
+/* Map the snapshot at PATH into V, if it is valid and up to date with
+   SOURCE. */
+static unsigned int
+map_snapshot(struct config_version *v, const char *path, const char *source)
+{
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) == -1)
+        return 0;
+
+    return map_snapshot_fd(v, fd, source);
+}
+
+/* Replace the table with the snapshot at PATH, written by cConfig_compile.
+   Options are used straight from the mapping, nothing is parsed or
+   copied. If the snapshot is missing, damaged or older than SOURCE,
+   SOURCE is loaded as text instead. SOURCE may be NULL to only use the
+   snapshot. Returns 1 if the snapshot was used, 2 if SOURCE was, 0 if
+   neither could be loaded. Like cConfig_reload, other threads may keep
+   reading while this runs. */
+unsigned int
+cConfig_ctx_load_snapshot(cConfig_ctx *ctx, const char *path, const char *source)
+{
+    struct config_version *v;
+    uint64_t start;
+    unsigned int ret;
+
+    PROFILE_START(PROFILE_LOAD);
+
+    start = now_ns();
+    v = new_version();
+
+    if (map_snapshot(v, path, source))
+        ret = 1;
+    else
+    if (source && load_mmap(ctx, v, source))
+        ret = 2;
+    else
+    {
+        free_version(v);
+        return 0;
+    }
+
+    pthread_mutex_lock(&ctx->write_lock);
+
+    publish(ctx, v);
+    count_load(ctx, start);
+    replace_version(ctx, v);
+
+    pthread_mutex_unlock(&ctx->write_lock);
+
+    PROFILE_END(PROFILE_LOAD);
+
+    return ret;
+}
+
+/* The segment cConfig_publish_shm names NAME. The snapshots are in
+   segments named NAME.<generation>. */
+struct shm_control
+{
+    char magic[8];
+
+    /* The generation to attach, 0 if none was published yet. Only
+       changed with the segment locked by flock. */
+    uint64_t generation;
+};
+
+/* Name of the segment with generation GEN of NAME, from xmalloc. */
+static char *
+shm_name(const char *name, uint64_t gen)
+{
+    char *seg;
+
+    seg = xmalloc(strlen(name) + 22);
+    sprintf(seg, "%s.%llu", name, (unsigned long long)gen);
+
+    return seg;
+}
+
+/* Write the current table of CTX to a POSIX shared memory segment as a
+   snapshot, and make it the generation of NAME that cConfig_attach_shm
+   maps. NAME is a shared memory name, "/myapp". The previous generation
+   is unlinked, processes that attached it keep it until they attach
+   another one. Publishers in different processes take turns. Returns
+   non zero on success. */
+unsigned int
+cConfig_ctx_publish_shm(cConfig_ctx *ctx, const char *name)
+{
+    struct snapshot_header header;
+    struct shm_control *ctl;
+    struct stat st;
+    uint64_t gen;
+    char *base, *data, *seg;
+    int fd, seg_fd;
+    unsigned int ret = 0;
+
+    memset(&header, 0, sizeof(header));
+
+    pthread_mutex_lock(&ctx->write_lock);
+
+    if (ctx->current == NULL)
+    {
+        pthread_mutex_unlock(&ctx->write_lock);
+        return 0;
+    }
+
+    base = build_image(ctx->current, &header);
+
+    pthread_mutex_unlock(&ctx->write_lock);
+
+    if ((fd = shm_open(name, O_RDWR | O_CREAT, 0644)) == -1)
+    {
+        xfree(base);
+        return 0;
+    }
+
+    flock(fd, LOCK_EX);
+
+    if (fstat(fd, &st) == -1 ||
+        ((size_t)st.st_size < sizeof(*ctl) && ftruncate(fd, sizeof(*ctl)) == -1) ||
+        (ctl = mmap(NULL, sizeof(*ctl), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+        goto out;
+
+    if (memcmp(ctl->magic, SHM_MAGIC, sizeof(ctl->magic)) != 0)
+    {
+        memcpy(ctl->magic, SHM_MAGIC, sizeof(ctl->magic));
+        ctl->generation = 0;
+    }
+
+    gen = ctl->generation + 1;
+    seg = shm_name(name, gen);
+
+    if ((seg_fd = shm_open(seg, O_RDWR | O_CREAT | O_TRUNC, 0644)) != -1)
+    {
+        if (ftruncate(seg_fd, header.size) == 0)
+        {
+            data = mmap(NULL, header.size, PROT_READ | PROT_WRITE, MAP_SHARED, seg_fd, 0);
+
+            if (data != MAP_FAILED)
+            {
+                memcpy(data, base, header.size);
+                munmap(data, header.size);
+                ret = 1;
+            }
+        }
+
+        close(seg_fd);
+
+        if (!ret)
+            shm_unlink(seg);
+    }
+
+    xfree(seg);
+
+    if (ret)
+    {
+        __atomic_store_n(&ctl->generation, gen, __ATOMIC_RELEASE);
+
+        if (gen > 1)
+        {
+            seg = shm_name(name, gen - 1);
+            shm_unlink(seg);
+            xfree(seg);
+        }
+    }
+
+    munmap(ctl, sizeof(*ctl));
+
+out:
+    flock(fd, LOCK_UN);
+    close(fd);
+    xfree(base);
+
+    return ret;
+}
+
+/* Replace the table with the generation of NAME last published by
+   cConfig_publish_shm. Like a snapshot, options are used straight from
+   the shared mapping, only the records of the options a process looks
+   up are copied into it. Calling it again attaches a newer generation,
+   or does nothing if there is none. Returns non zero on success. */
+unsigned int
+cConfig_ctx_attach_shm(cConfig_ctx *ctx, const char *name)
+{
+    struct config_version *v, *cur;
+    struct shm_control *ctl;
+    struct snapshot *s;
+    struct stat st;
+    uint64_t gen;
+    uint64_t start;
+    char *seg;
+    int fd, seg_fd, tries;
+    unsigned int same;
+
+    PROFILE_START(PROFILE_LOAD);
+
+    start = now_ns();
+
+    if ((fd = shm_open(name, O_RDONLY, 0)) == -1)
+        return 0;
+
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(*ctl) ||
+        (ctl = mmap(NULL, sizeof(*ctl), PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        close(fd);
+        return 0;
+    }
+
+    close(fd);
+
+    /* A publisher may unlink the generation read before it is opened,
+       the next one is there by then. */
+    seg_fd = -1;
+
+    for (tries = 0; tries < SHM_ATTACH_TRIES && seg_fd == -1; ++tries)
+    {
+        gen = __atomic_load_n(&ctl->generation, __ATOMIC_ACQUIRE);
+
+        if (memcmp(ctl->magic, SHM_MAGIC, sizeof(ctl->magic)) != 0 || gen == 0)
+            break;
+
+        seg = shm_name(name, gen);
+        seg_fd = shm_open(seg, O_RDONLY, 0);
+        xfree(seg);
+    }
+
+    munmap(ctl, sizeof(*ctl));
+
+    if (seg_fd == -1 || fstat(seg_fd, &st) == -1)
+    {
+        if (seg_fd != -1)
+            close(seg_fd);
+
+        return 0;
+    }
+
+    pthread_mutex_lock(&ctx->write_lock);
+
+    cur = ctx->current;
+    s = cur ? cur->snapshot : NULL;
+    same = s && s->dev == st.st_dev && s->ino == st.st_ino;
+
+    pthread_mutex_unlock(&ctx->write_lock);
+
+    if (same)
+    {
+        close(seg_fd);
+        PROFILE_END(PROFILE_LOAD);
+        return 1;
+    }
+
+    v = new_version();
+
+    if (!map_snapshot_fd(v, seg_fd, NULL))
+    {
+        free_version(v);
+        return 0;
+    }
+
+    pthread_mutex_lock(&ctx->write_lock);
+
+    publish(ctx, v);
+    count_load(ctx, start);
+    replace_version(ctx, v);
+
+    pthread_mutex_unlock(&ctx->write_lock);
+
+    PROFILE_END(PROFILE_LOAD);
+
+    return 1;
+}
+
+/* An option cConfig_freeze places, HASH is its hash_key. */
+struct freeze_key
+{
+    uint64_t hash;
+    uint64_t mixed;
+    cConfig_opt *opt;
+};
+
+/* Options collected from the table being frozen. */
+struct freeze_job
+{
+    struct freeze_key *keys;
+    size_t count;
+};
+
+static void
+add_freeze_key(cConfig_opt *opt, uint64_t hash, void *arg)
+{
+    struct freeze_job *job = arg;
+    struct freeze_key *key = &job->keys[job->count++];
+
+    key->hash = hash;
+    key->mixed = frozen_mix(hash);
+    key->opt = opt;
+}
+
+/* Copy what lookups need of OPT into SLOT of F, the caches stay empty
+   until the copy is used. Other threads may be filling in the caches
+   of OPT so it isn't copied as a whole. */
+static void
+place_opt(struct frozen *f, size_t slot, struct freeze_key *key)
+{
+    cConfig_opt *opt = &f->opts[slot];
+
+    opt->name = key->opt->name;
+    opt->value = key->opt->value;
+    opt->is_array = key->opt->is_array;
+    opt->values = key->opt->values;
+    opt->size = key->opt->size;
+    opt->name_len = key->opt->name_len;
+    opt->value_len = key->opt->value_len;
+    opt->value_lens = key->opt->value_lens;
+    opt->is_mapped = key->opt->is_mapped;
+    opt->cache_type = CCONFIG_NONE;
+    opt->int_values = NULL;
+    opt->double_values = NULL;
+    opt->index = NULL;
+
+    f->hashes[slot] = key->hash;
+}
+
+/* Find a seed that sends the N keys in KEYS (a bucket) to different
+   free slots of F, and place them. SLOTS has room for N slots. */
+static unsigned int
+place_bucket(struct frozen *f, struct freeze_key **keys, size_t n, unsigned char *taken,
+             size_t *slots, uint32_t *seed)
+{
+    size_t i, j;
+    uint32_t s;
+
+    /* Keys with the same hash never end up in different slots. */
+    for (i = 0; i < n; ++i)
+        for (j = 0; j < i; ++j)
+            if (keys[i]->hash == keys[j]->hash)
+                return 0;
+
+    for (s = 0; s < FROZEN_MAX_SEED; ++s)
+    {
+        for (i = 0; i < n; ++i)
+        {
+            slots[i] = frozen_slot(keys[i]->mixed, s, f->count);
+
+            if (taken[slots[i]])
+                break;
+
+            for (j = 0; j < i && slots[j] != slots[i]; ++j)
+                ;
+
+            if (j < i)
+                break;
+        }
+
+        if (i == n)
+        {
+            for (i = 0; i < n; ++i)
+            {
+                taken[slots[i]] = 1;
+                place_opt(f, slots[i], keys[i]);
+            }
+
+            *seed = s;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Build the perfect hash over the N options in KEYS. Buckets are
+   placed from the largest down, while most slots are still free, and
+   buckets of a single option go straight to one of the slots left. */
+static struct frozen *
+new_frozen(struct freeze_key *keys, size_t n)
+{
+    struct frozen *f;
+    struct freeze_key **sorted;
+    size_t i, b, size, max, *first, *order, *by_size, *slots;
+    unsigned char *taken;
+    unsigned int ok = 1;
+
+    if (n >= FROZEN_DIRECT)
+        return NULL;
+
+    f = xmalloc(sizeof(struct frozen));
+
+    f->count = n;
+    f->buckets = n / FROZEN_BUCKET_KEYS + 1;
+    f->seeds = xcalloc(f->buckets, sizeof(uint32_t));
+    f->hashes = xcalloc(n + 1, sizeof(uint64_t));
+    f->opts = xcalloc(n + 1, sizeof(cConfig_opt));
+
+    /* Group the keys by bucket, bucket B has the keys from FIRST[B]
+       up to FIRST[B + 1] in SORTED. */
+    first = xcalloc(f->buckets + 1, sizeof(size_t));
+    sorted = xcalloc(n + 1, sizeof(struct freeze_key *));
+
+    for (i = 0; i < n; ++i)
+        first[FROZEN_RANGE(keys[i].mixed, f->buckets) + 1]++;
+
+    for (b = 0, max = 0; b < f->buckets; ++b)
+    {
+        if (first[b + 1] > max)
+            max = first[b + 1];
+
+        first[b + 1] += first[b];
+    }
+
+    for (i = 0; i < n; ++i)
+    {
+        b = FROZEN_RANGE(keys[i].mixed, f->buckets);
+        sorted[--first[b + 1]] = &keys[i];
+    }
+
+    /* first[b + 1] went back to where bucket B starts, move it up. */
+    memmove(first, first + 1, f->buckets * sizeof(size_t));
+    first[f->buckets] = n;
+
+    /* The buckets from the largest to the smallest. */
+    by_size = xcalloc(max + 2, sizeof(size_t));
+    order = xcalloc(f->buckets, sizeof(size_t));
+
+    for (b = 0; b < f->buckets; ++b)
+        by_size[max - (first[b + 1] - first[b]) + 1]++;
+
+    for (size = 0; size <= max; ++size)
+        by_size[size + 1] += by_size[size];
+
+    for (b = 0; b < f->buckets; ++b)
+        order[by_size[max - (first[b + 1] - first[b])]++] = b;
+
+    taken = xcalloc(n + 1, 1);
+    slots = xcalloc(max + 1, sizeof(size_t));
+
+    for (i = 0, size = 0; ok && i < f->buckets; ++i)
+    {
+        b = order[i];
+
+        switch (first[b + 1] - first[b])
+        {
+        case 0:
+            break;
+
+        case 1:
+            while (taken[size])
+                size++;
+
+            taken[size] = 1;
+            place_opt(f, size, sorted[first[b]]);
+            f->seeds[b] = FROZEN_DIRECT | size;
+            break;
+
+        default:
+            ok = place_bucket(f, &sorted[first[b]], first[b + 1] - first[b], taken,
+                              slots, &f->seeds[b]);
+            break;
+        }
+    }
+
+    xfree(slots);
+    xfree(taken);
+    xfree(order);
+    xfree(by_size);
+    xfree(sorted);
+    xfree(first);
+
+    if (!ok)
+    {
+        xfree(f->seeds);
+        xfree(f->hashes);
+        xfree(f->opts);
+        xfree(f);
+        return NULL;
+    }
+
+    return f;
+}
+
+/* Move every option of the current table into a minimal perfect hash
+   table, after which a lookup is one hash, one probe and one compare.
+   The table can't be changed anymore, cConfig_load, cConfig_add_opt
+   and the like fail, until it is replaced by cConfig_reload or
+   cConfig_load_snapshot or released by cConfig_free. Like
+   cConfig_reload, other threads may keep reading while this runs.
+   Returns non zero on success. */
+unsigned int
+cConfig_ctx_freeze(cConfig_ctx *ctx)
+{
+    struct config_version *old, *v;
+    struct freeze_job job;
+    struct frozen *f;
+
+    pthread_mutex_lock(&ctx->write_lock);
+
+    if ((old = ctx->current) == NULL || old->frozen)
+    {
+        pthread_mutex_unlock(&ctx->write_lock);
+        return old != NULL;
+    }
+
+    job.count = 0;
+    job.keys = xcalloc(version_size(old) + 1, sizeof(struct freeze_key));
+
+    /* Options of a lazily loaded file are parsed now. */
+    walk_version(old, add_freeze_key, &job);
+
+    f = new_frozen(job.keys, job.count);
+    xfree(job.keys);
+
+    if (f == NULL)
+    {
+        pthread_mutex_unlock(&ctx->write_lock);
+        cConfig_error("couldn't build a perfect hash, the table is left as it is");
+        return 0;
+    }
+
+    /* OLD isn't retired, the options still point into it. */
+    v = new_version();
+    v->frozen = f;
+    v->base = old;
+    v->opt_count = f->count;
+    v->elem_count = __atomic_load_n(&old->elem_count, __ATOMIC_RELAXED);
+
+    publish(ctx, v);
+    __atomic_store_n(&ctx->current, v, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_unlock(&ctx->write_lock);
+
+    return 1;
+}
+
+/* A file cConfig_watch keeps the table of CTX in sync with. */
+struct watch
+{
+    cConfig_ctx *ctx;
+    char *path;
+
+    /* The last part of PATH. Its directory is watched rather than the
+       file, so editors that write a new file and rename it over the
+       old one are seen too. */
+    const char *name;
+
+    int inotify;
+    int stop[2];
+    pthread_t thread;
+    unsigned int running;
+
+    cConfig_watch_fn callback;
+    void *user;
+
+    /* Options of watched tables and their caches are allocated from
+       here with its lock held, so an option that doesn't change can be
+       kept by the next version. ALLOCATED is what options copied into
+       it take and LIVE what those of the current version take, see
+       apply_watch. */
+    struct watch_arena *arena;
+    size_t allocated;
+    size_t live;
+};
+
+/* An option apply_watch found added, changed or removed. */
+struct watch_change
+{
+    unsigned int change;
+    const char *name;
+    const cConfig_opt *old;
+    const cConfig_opt *new;
+};
+
+/* The new version apply_watch builds and how it differs from OLD. */
+struct watch_diff
+{
+    struct watch *w;
+    struct config_version *old;
+    struct config_version *v;
+
+    /* Non zero if the options of OLD live in the arena of W. */
+    unsigned int reuse;
+
+    /* Memory the options of V take. */
+    size_t live;
+
+    struct watch_change *changes;
+    size_t count;
+    size_t size;
+};
+
+static unsigned int
+opt_equal(const cConfig_opt *a, const cConfig_opt *b)
+{
+    size_t i;
+
+    if (a->is_array != b->is_array)
+        return 0;
+
+    if (!a->is_array)
+    {
+        if (a->value == NULL || b->value == NULL)
+            return a->value == b->value;
+
+        return a->value_len == b->value_len && memcmp(a->value, b->value, a->value_len) == 0;
+    }
+
+    if (a->size != b->size)
+        return 0;
+
+    for (i = 0; i < a->size; ++i)
+        if (a->value_lens[i] != b->value_lens[i]
+            || memcmp(a->values[i], b->values[i], a->value_lens[i]) != 0)
+            return 0;
+
+    return 1;
+}
+
+/* Memory copy_opt takes for a copy of OPT. */
+static size_t
+opt_bytes(const cConfig_opt *opt)
+{
+    size_t i, bytes;
+
+    bytes = sizeof(cConfig_opt) + opt->name_len + 1;
+
+    if (opt->value)
+        bytes += opt->value_len + 1;
+
+    if (opt->is_array)
+        for (bytes += opt->size * (sizeof(char *) + sizeof(size_t)), i = 0; i < opt->size; ++i)
+            bytes += opt->value_lens[i] + 1;
+
+    return bytes;
+}
+
+/* Copy SRC into ARENA, arrays laid out like cConfig_add_opt_array
+   lays them out. The caches start out empty. */
+static cConfig_opt *
+copy_opt(Arena *arena, const cConfig_opt *src)
+{
+    cConfig_opt *opt;
+    size_t i, bytes, *lens;
+    char *out;
+
+    opt = arena_alloc(arena, sizeof(cConfig_opt));
+
+    opt->name = arena_dupstrn(arena, src->name, src->name_len);
+    opt->name_len = src->name_len;
+    opt->value = src->value ? arena_dupstrn(arena, src->value, src->value_len) : NULL;
+    opt->value_len = src->value_len;
+    opt->is_array = src->is_array;
+    opt->size = src->size;
+    opt->values = NULL;
+    opt->value_lens = NULL;
+    opt->is_mapped = 0;
+    opt->cache_type = CCONFIG_NONE;
+    opt->int_values = NULL;
+    opt->double_values = NULL;
+    opt->index = NULL;
+
+    if (!src->is_array)
+        return opt;
+
+    bytes = src->size * (sizeof(char *) + sizeof(size_t));
+
+    for (i = 0; i < src->size; ++i)
+        bytes += src->value_lens[i] + 1;
+
+    opt->values = arena_alloc(arena, bytes);
+    lens = (size_t *)(opt->values + src->size);
+    out = (char *)(lens + src->size);
+
+    for (i = 0; i < src->size; ++i)
+    {
+        lens[i] = src->value_lens[i];
+        memcpy(out, src->values[i], lens[i]);
+        out[lens[i]] = '\0';
+        opt->values[i] = out;
+        out += lens[i] + 1;
+    }
+
+    opt->value_lens = lens;
+
+    return opt;
+}
+
+static void
+add_change(struct watch_diff *diff, unsigned int change, const char *name,
+           const cConfig_opt *old, const cConfig_opt *new)
+{
+    struct watch_change *c;
+
+    if (diff->count == diff->size)
+    {
+        diff->size = diff->size ? diff->size * 2 : 16;
+        diff->changes = xrealloc(diff->changes, diff->size * sizeof(struct watch_change));
+    }
+
+    c = &diff->changes[diff->count++];
+    c->change = change;
+    c->name = name;
+    c->old = old;
+    c->new = new;
+}
+
+/* Put OPT, parsed from the file, into the new version: the option of
+   the old version if it is the same, else a copy. */
+static void
+diff_parsed(cConfig_opt *opt, uint64_t hash, void *arg)
+{
+    struct watch_diff *diff = arg;
+    cConfig_opt *old, *keep;
+
+    old = diff->old ? find_opt_hashed(diff->old, opt->name, hash) : NULL;
+
+    if (old && opt_equal(old, opt) && diff->reuse)
+        keep = old;
+    else
+    {
+        keep = copy_opt(diff->w->arena->arena, opt);
+        diff->w->allocated += opt_bytes(keep);
+
+        if (old == NULL)
+            add_change(diff, CCONFIG_ADDED, keep->name, NULL, keep);
+        else if (!opt_equal(old, opt))
+            add_change(diff, CCONFIG_CHANGED, keep->name, old, keep);
+    }
+
+    diff->live += opt_bytes(keep);
+    insert_opt(diff->v, keep);
+}
+
+static void
+diff_removed(cConfig_opt *opt, uint64_t hash, void *arg)
+{
+    struct watch_diff *diff = arg;
+
+    if (find_opt_hashed(diff->v, opt->name, hash) == NULL)
+        add_change(diff, CCONFIG_REMOVED, opt->name, opt, NULL);
+}
+
+/* Parse the watched file and swap in a version with its options,
+   keeping the options that didn't change. If NOTIFY is non zero the
+   callback is then told about every option that did. Returns 0, and
+   keeps the current table, if the file doesn't load. */
+static unsigned int
+apply_watch(struct watch *w, unsigned int notify)
+{
+    cConfig_ctx *ctx = w->ctx;
+    struct config_version *parsed;
+    struct watch_diff diff;
+    struct watch_change *c;
+    uint64_t start;
+    size_t i;
+
+    start = now_ns();
+    parsed = new_version();
+
+    if (!load_mmap(ctx, parsed, w->path))
+    {
+        free_version(parsed);
+        return 0;
+    }
+
+    diff.w = w;
+    diff.changes = NULL;
+    diff.count = 0;
+    diff.size = 0;
+
+    /* The old options have to stay valid until the callback saw them. */
+    epoch_enter();
+    pthread_mutex_lock(&ctx->write_lock);
+
+    diff.old = ctx->current;
+
+    /* Options that changed stay in the arena until it is released, so
+       once they take more than the options in use a new arena is
+       started and every option copied into it. The old one is freed
+       with the last version that uses it. */
+    if (w->allocated - w->live > w->live && w->allocated - w->live >= WATCH_COMPACT_MIN)
+    {
+        release_watch_arena(w->arena);
+        w->arena = new_watch_arena();
+        w->allocated = 0;
+    }
+
+    diff.reuse = diff.old && diff.old->watch_arena == w->arena && diff.old->frozen == NULL;
+    diff.live = 0;
+
+    diff.v = new_version();
+    use_watch_arena(diff.v, w->arena);
+
+    pthread_mutex_lock(&w->arena->lock);
+    walk_version(parsed, diff_parsed, &diff);
+    pthread_mutex_unlock(&w->arena->lock);
+
+    w->live = diff.live;
+
+    if (diff.old)
+        walk_version(diff.old, diff_removed, &diff);
+
+    publish(ctx, diff.v);
+    count_load(ctx, start);
+    replace_version(ctx, diff.v);
+
+    pthread_mutex_unlock(&ctx->write_lock);
+
+    free_version(parsed);
+
+    for (i = 0; notify && w->callback && i < diff.count; ++i)
+    {
+        c = &diff.changes[i];
+        w->callback(w->user, c->name, c->change, c->old, c->new);
+    }
+
+    epoch_leave();
+    xfree(diff.changes);
+
+    return 1;
+}
+
+/* Wait for changes to the watched file and apply them, until
+   something is written to the stop pipe. */
+static void *
+watch_thread(void *arg)
+{
+    struct watch *w = arg;
+    struct inotify_event *event;
+    struct pollfd fds[2];
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    unsigned int changed;
+    ssize_t n;
+    char *p;
+
+    fds[0].fd = w->inotify;
+    fds[0].events = POLLIN;
+    fds[1].fd = w->stop[0];
+    fds[1].events = POLLIN;
+
+    for (;;)
+    {
+        if (poll(fds, 2, -1) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            break;
+        }
+
+        if (fds[1].revents)
+            break;
+
+        /* Apply a burst of events once. */
+        changed = 0;
+
+        while ((n = read(w->inotify, buf, sizeof(buf))) > 0)
+        {
+            for (p = buf; p < buf + n; p += sizeof(struct inotify_event) + event->len)
+            {
+                event = (struct inotify_event *)p;
+
+                if (event->len && strcmp(event->name, w->name) == 0)
+                    changed = 1;
+            }
+        }
+
+        if (changed && !apply_watch(w, 1))
+            cConfig_error("couldn't reload %s, the table is left as it is", w->path);
+    }
+
+    return NULL;
+}
+
+/* Non zero while a thread keeps the table of CTX in sync with a file. */
+static unsigned int
+watching(cConfig_ctx *ctx)
+{
+    return ctx->watch && __atomic_load_n(&ctx->watch->running, __ATOMIC_ACQUIRE);
+}
+
+/* Stop the thread watching the file of CTX, if there is one. The
+   options it loaded stay. */
+static void
+stop_watch(cConfig_ctx *ctx)
+{
+    struct watch *w = ctx->watch;
+
+    if (w == NULL)
+        return;
+
+    if (w->running)
+    {
+        if (write(w->stop[1], "", 1) == 1)
+            pthread_join(w->thread, NULL);
+
+        __atomic_store_n(&w->running, 0, __ATOMIC_RELEASE);
+    }
+
+    if (w->inotify != -1)
+        close(w->inotify);
+
+    if (w->stop[0] != -1)
+    {
+        close(w->stop[0]);
+        close(w->stop[1]);
+    }
+
+    w->inotify = -1;
+    w->stop[0] = -1;
+    w->stop[1] = -1;
+}
+
+/* Free the watch of CTX. Its options are released with the last
+   version that uses them. */
+static void
+free_watch(cConfig_ctx *ctx)
+{
+    struct watch *w = ctx->watch;
+
+    if (w == NULL)
+        return;
+
+    release_watch_arena(w->arena);
+    xfree(w->path);
+    xfree(w);
+
+    ctx->watch = NULL;
+}
+
+/* Replace what was loaded with FILENAME and keep the table in sync
+   with it: a thread waits for the file to be written or replaced and
+   loads it again. Options that didn't change are kept, until apply_watch
+   copies them all to release those that did, and CALLBACK is called
+   with USER for every option that was added, changed or removed. The
+   table can't be changed in place anymore, only through the file or by
+   replacing it with cConfig_reload. Watching another file stops
+   watching this one. Options of an earlier watch aren't kept, they are
+   released with the table that has them like any other. Returns non
+   zero on success. */
+unsigned int
+cConfig_ctx_watch(cConfig_ctx *ctx, const char *filename, cConfig_watch_fn callback, void *user)
+{
+    struct watch *w;
+    const char *slash;
+    char *dir;
+    size_t len;
+
+    stop_watch(ctx);
+
+    if ((w = ctx->watch) == NULL)
+    {
+        w = xcalloc(1, sizeof(struct watch));
+        w->ctx = ctx;
+        w->inotify = -1;
+        w->stop[0] = -1;
+        w->stop[1] = -1;
+
+        ctx->watch = w;
+    }
+    else
+        release_watch_arena(w->arena);
+
+    w->arena = new_watch_arena();
+    w->allocated = 0;
+    w->live = 0;
+
+    xfree(w->path);
+    w->path = dupstr(filename);
+    w->callback = callback;
+    w->user = user;
+
+    if ((slash = strrchr(w->path, '/')) == NULL)
+    {
+        w->name = w->path;
+        dir = dupstr(".");
+    }
+    else
+    {
+        w->name = slash + 1;
+        len = slash == w->path ? 1 : (size_t)(slash - w->path);
+        dir = xmalloc(len + 1);
+        memcpy(dir, w->path, len);
+        dir[len] = '\0';
+    }
+
+    /* Watch before loading so a change in between isn't missed. */
+    w->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (w->inotify == -1 || inotify_add_watch(w->inotify, dir, IN_CLOSE_WRITE | IN_MOVED_TO) == -1)
+    {
+        cConfig_error("couldn't watch %s: %s", dir, strerror(errno));
+        xfree(dir);
+        goto out;
+    }
+
+    xfree(dir);
+
+    if (pipe(w->stop) == -1)
+    {
+        w->stop[0] = -1;
+        goto out;
+    }
+
+    if (!apply_watch(w, 0))
+        goto out;
+
+    if (pthread_create(&w->thread, NULL, watch_thread, w) != 0)
+        goto out;
+
+    __atomic_store_n(&w->running, 1, __ATOMIC_RELEASE);
+    return 1;
+
+out:
+    stop_watch(ctx);
+    return 0;
+}
+
+/* Stop keeping the table of CTX in sync with the watched file, the
+   table stays as it is. Waits for a reload in progress, so it can't be
+   called from the callback. */
+void
+cConfig_ctx_unwatch(cConfig_ctx *ctx)
+{
+    stop_watch(ctx);
+}
+
+/* Fill in STATS for CTX. The options aren't looked at, only the
+   buckets of the table for the histogram. Returns non zero on success. */
+unsigned int
+cConfig_ctx_get_stats(cConfig_ctx *ctx, struct cConfig_stats *stats)
+{
+    struct config_version *v;
+
+    memset(stats, 0, sizeof(*stats));
+
+    pthread_mutex_lock(&ctx->write_lock);
+
+    stats->load_ns = __atomic_load_n(&ctx->load_ns, __ATOMIC_RELAXED);
+    stats->bytes_parsed = __atomic_load_n(&ctx->load_bytes, __ATOMIC_RELAXED);
+    stats->lines_parsed = __atomic_load_n(&ctx->load_lines, __ATOMIC_RELAXED);
+
+    if ((v = ctx->current) != NULL)
+    {
+        stats->options = v->opt_count;
+        stats->array_elements = __atomic_load_n(&v->elem_count, __ATOMIC_RELAXED);
+    }
+
+    if (v && v->frozen)
+    {
+        /* Every option is one probe away. */
+        stats->table_size = v->frozen->count;
+        stats->table_count = v->frozen->count;
+        stats->chains[1] = v->frozen->count;
+    }
+    else
+    if (v)
+    {
+        stats->table_size = v->table->size;
+        stats->table_count = v->table->count;
+        hash_table_chains(v->table, stats->chains, CCONFIG_STATS_CHAINS);
+    }
+
+    pthread_mutex_unlock(&ctx->write_lock);
+
+    if (stats->table_size)
+        stats->load_factor = (double)stats->table_count / stats->table_size;
+
+    alloc_stats(&stats->alloc_bytes, &stats->allocs);
+
+#ifdef CCONFIG_STATS
+    epoch_lookup_counts(&stats->lookup_hits, &stats->lookup_misses);
+#endif
+
+    return 1;
+}
+
+/* Write the latencies recorded in all contexts to F. Only a library
+   built with PROFILE=1 records them, otherwise this writes nothing and
+   returns 0. */
+unsigned int
+cConfig_profile_dump(FILE *f)
+{
+#ifdef CCONFIG_PROFILE
+    profile_dump(f);
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/* The functions below use the default context. */
+
+void
+cConfig_init(void)
+{
+    init_ctx(&default_ctx);
+}
+
+unsigned int
+cConfig_load(const char *filename)
+{
+    return cConfig_ctx_load(&default_ctx, filename);
+}
+
+unsigned int
+cConfig_load_mmap(const char *filename)
+{
+    return cConfig_ctx_load_mmap(&default_ctx, filename);
+}
+
+unsigned int
+cConfig_load_parallel(const char *filename, int threads)
+{
+    return cConfig_ctx_load_parallel(&default_ctx, filename, threads);
+}
+
+unsigned int
+cConfig_load_buffer(const char *string, size_t len)
+{
+    return cConfig_ctx_load_buffer(&default_ctx, string, len);
+}
+
+unsigned int
+cConfig_load_fd(int fd)
+{
+    return cConfig_ctx_load_fd(&default_ctx, fd);
+}
+
+unsigned int
+cConfig_parse_stream(FILE *f, const cConfig_callbacks *cb, void *user)
+{
+    return cConfig_ctx_parse_stream(&default_ctx, f, cb, user);
+}
+
+unsigned int
+cConfig_parse_fd(int fd, const cConfig_callbacks *cb, void *user)
+{
+    return cConfig_ctx_parse_fd(&default_ctx, fd, cb, user);
+}
+
+unsigned int
+cConfig_parse_buffer(const char *string, size_t len, const cConfig_callbacks *cb, void *user)
+{
+    return cConfig_ctx_parse_buffer(&default_ctx, string, len, cb, user);
+}
+
+unsigned int
+cConfig_load_filtered(const char *filename, const char **prefixes, size_t count)
+{
+    return cConfig_ctx_load_filtered(&default_ctx, filename, prefixes, count);
+}
+
+unsigned int
+cConfig_load_lazy(const char *filename)
+{
+    return cConfig_ctx_load_lazy(&default_ctx, filename);
+}
+
+unsigned int
+cConfig_reload(const char *filename)
+{
+    return cConfig_ctx_reload(&default_ctx, filename);
+}
+
+unsigned int
+cConfig_load_many(const char **files, size_t count, int threads, cConfig_load_status *status)
+{
+    return cConfig_ctx_load_many(&default_ctx, files, count, threads, status);
+}
+
+unsigned int
+cConfig_compile(const char *source, const char *path)
+{
+    return cConfig_ctx_compile(&default_ctx, source, path);
+}
+
+unsigned int
+cConfig_load_snapshot(const char *path, const char *source)
+{
+    return cConfig_ctx_load_snapshot(&default_ctx, path, source);
+}
+
+unsigned int
+cConfig_publish_shm(const char *name)
+{
+    return cConfig_ctx_publish_shm(&default_ctx, name);
+}
+
+unsigned int
+cConfig_attach_shm(const char *name)
+{
+    return cConfig_ctx_attach_shm(&default_ctx, name);
+}
+
+unsigned int
+cConfig_freeze(void)
+{
+    return cConfig_ctx_freeze(&default_ctx);
+}
+
+unsigned int
+cConfig_watch(const char *filename, cConfig_watch_fn callback, void *user)
+{
+    return cConfig_ctx_watch(&default_ctx, filename, callback, user);
+}
+
+void
+cConfig_unwatch(void)
+{
+    cConfig_ctx_unwatch(&default_ctx);
+}
+
+unsigned int
+cConfig_get_stats(struct cConfig_stats *stats)
+{
+    return cConfig_ctx_get_stats(&default_ctx, stats);
+}
+
+/* Release the table and everything loaded into it, after waiting for
+   the threads still reading it. */
+void
+cConfig_free(void)
+{
+    free_ctx(&default_ctx);
+}
+
+cConfig_opt *
+cConfig_add_opt(const char *name, const char *value)
+{
+    return cConfig_ctx_add_opt(&default_ctx, name, value);
+}
+
+cConfig_opt *
+cConfig_add_opt_array(const char *name, char **values, const size_t size)
+{
+    return cConfig_ctx_add_opt_array(&default_ctx, name, values, size);
+}
+
+cConfig_opt *
+cConfig_get_opt(const char *name)
+{
+    return cConfig_ctx_get_opt(&default_ctx, name);
+}
+
+char *
+cConfig_get_value(const char *name)
+{
+    return cConfig_ctx_get_value(&default_ctx, name);
+}
+
+cConfig_key_t
+cConfig_resolve(const char *name)
+{
+    return cConfig_ctx_resolve(&default_ctx, name);
+}
+
+void
+cConfig_set_delim(char d)
+{
+    cConfig_ctx_set_delim(&default_ctx, d);
+}
+
+unsigned int
+cConfig_find_opt_value(char *name, char *value)
+{
+    return cConfig_ctx_find_opt_value(&default_ctx, name, value);
+}
+
+unsigned int
+cConfig_find_opt_value_n(const char *name, const char *value, size_t len)
+{
+    return cConfig_ctx_find_opt_value_n(&default_ctx, name, value, len);
+}
+
+void
+cConfig_print_opt(char *name)
+{
+    cConfig_ctx_print_opt(&default_ctx, name);
+}
+
+unsigned int
+cConfig_get_int(const char *name, int64_t *value)
+{
+    return cConfig_ctx_get_int(&default_ctx, name, value);
+}
+
+unsigned int
+cConfig_get_double(const char *name, double *value)
+{
+    return cConfig_ctx_get_double(&default_ctx, name, value);
+}
+
+unsigned int
+cConfig_get_bool(const char *name, unsigned int *value)
+{
+    return cConfig_ctx_get_bool(&default_ctx, name, value);
+}
+
+unsigned int
+cConfig_get_bytes(const char *name, uint64_t *value)
+{
+    return cConfig_ctx_get_bytes(&default_ctx, name, value);
+}
+
+unsigned int
+cConfig_get_duration(const char *name, int64_t *value)
+{
+    return cConfig_ctx_get_duration(&default_ctx, name, value);
+}
+
+int64_t *
+cConfig_get_int_array(const char *name, size_t *size)
+{
+    return cConfig_ctx_get_int_array(&default_ctx, name, size);
+}
+
+double *
+cConfig_get_double_array(const char *name, size_t *size)
+{
+    return cConfig_ctx_get_double_array(&default_ctx, name, size);
+}
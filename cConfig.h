@@ -28,7 +28,17 @@
 #ifndef CCONFIG_H
 #define CCONFIG_H
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+
+/* Types the typed accessors parse values as. */
+#define CCONFIG_NONE      0
+#define CCONFIG_INT       1
+#define CCONFIG_DOUBLE    2
+#define CCONFIG_BOOL      3
+#define CCONFIG_BYTES     4
+#define CCONFIG_DURATION  5
 
 struct config_opt
 {
@@ -46,22 +56,288 @@ struct config_opt
 
     /* Number of values. */
     size_t size;
+
+    /* Length of the name and value, not counting the terminating NUL. */
+    size_t name_len;
+    size_t value_len;
+
+    /* Length of every element of an array, NULL if this opt isn't one. */
+    size_t *value_lens;
+
+    /* Non zero if the name and values point into a file loaded by
+       cConfig_load_mmap rather than being owned by the option. */
+    unsigned int is_mapped;
+
+    /* The value as parsed by the first typed accessor used on this
+       option, CACHE_TYPE is the CCONFIG_ type it was parsed as. */
+    unsigned int cache_type;
+
+    union
+    {
+        int64_t i;
+        uint64_t u;
+        double d;
+    } cache;
+
+    /* The elements of an array as parsed by cConfig_get_int_array
+       and cConfig_get_double_array, NULL until first used. */
+    int64_t *int_values;
+    double *double_values;
+
+    /* Index cConfig_find_opt_value builds over a large array the first
+       time it is searched, NULL until then. */
+    struct cConfig_index *index;
 };
 
 typedef struct config_opt cConfig_opt;
 
+/* A name hashed once by cConfig_resolve. Stays valid across
+   cConfig_free and reloads until passed to cConfig_free_key. */
+typedef struct cConfig_key *cConfig_key_t;
+
+/* What cConfig_load_many did with one of the files. */
+struct cConfig_load_status
+{
+    /* Non zero if the file loaded without errors. */
+    unsigned int ok;
+
+    /* Number of options in the file. */
+    size_t options;
+
+    /* Time spent reading and parsing the file, in nanoseconds. */
+    uint64_t parse_ns;
+};
+
+typedef struct cConfig_load_status cConfig_load_status;
+
+/* What cConfig_parse_stream calls for every option it parses. The
+   names and values passed are NUL terminated, a callback returns 0 to
+   stop parsing. */
+struct cConfig_callbacks
+{
+    /* An option that isn't an array: user, name, name length, value
+       and value length. */
+    unsigned int (*on_opt)(void *, const char *, size_t, const char *, size_t);
+
+    /* An element of an array: user, name, name length, number of the
+       element, value and value length. */
+    unsigned int (*on_array_elem)(void *, const char *, size_t, size_t, const char *, size_t);
+};
+
+typedef struct cConfig_callbacks cConfig_callbacks;
+
+/* How an option changed, see cConfig_watch_fn. */
+#define CCONFIG_ADDED    1
+#define CCONFIG_CHANGED  2
+#define CCONFIG_REMOVED  3
+
+/* What cConfig_watch calls for every option that changed in the file:
+   user, name, CCONFIG_ADDED, CCONFIG_CHANGED or CCONFIG_REMOVED, and
+   the option before and after, NULL if it wasn't or isn't there. It
+   runs on the thread watching the file. */
+typedef void (*cConfig_watch_fn)(void *, const char *, unsigned int,
+                                 const cConfig_opt *, const cConfig_opt *);
+
+/* Number of entries in the chains histogram of cConfig_stats. */
+#define CCONFIG_STATS_CHAINS 16
+
+/* What cConfig_get_stats reports about a context. */
+struct cConfig_stats
+{
+    /* Loads into the table since the context was created or last freed:
+       wall time in nanoseconds, and the bytes and lines they parsed. */
+    uint64_t load_ns;
+    uint64_t bytes_parsed;
+    uint64_t lines_parsed;
+
+    /* Options lookups can find and elements of those that are arrays.
+       Options of a file loaded by cConfig_load_lazy are counted, their
+       elements only once they were parsed. */
+    size_t options;
+    size_t array_elements;
+
+    /* Buckets (or slots) of the hash table options are added to, the
+       options in it and their ratio. */
+    size_t table_size;
+    size_t table_count;
+    double load_factor;
+
+    /* CHAINS[i] is the number of buckets holding i options, the last
+       entry counts longer chains too. Built with HASH=open it is the
+       number of options found after i probes, CHAINS[0] the number of
+       empty slots. */
+    size_t chains[CCONFIG_STATS_CHAINS];
+
+    /* Bytes asked for and number of allocations made by the library in
+       all contexts, memory that was freed since included. Growing a
+       block only adds what it grew by. */
+    uint64_t alloc_bytes;
+    uint64_t allocs;
+
+    /* Lookups by name that found an option or nothing, in all contexts.
+       Only counted, per thread, by a library built with STATS=1. */
+    uint64_t lookup_hits;
+    uint64_t lookup_misses;
+};
+
+typedef struct cConfig_stats cConfig_stats;
+
+/* An independent configuration, see cConfig_ctx_new. The functions
+   without a context argument use a default context. */
+typedef struct cConfig_ctx cConfig_ctx;
+
 extern void cConfig_init(void);
 
 extern unsigned int cConfig_load(const char *);
 
+extern unsigned int cConfig_load_mmap(const char *);
+
+extern unsigned int cConfig_load_buffer(const char *, size_t);
+
+extern unsigned int cConfig_load_fd(int);
+
+extern unsigned int cConfig_load_parallel(const char *, int);
+
+extern unsigned int cConfig_load_filtered(const char *, const char **, size_t);
+
+extern unsigned int cConfig_parse_stream(FILE *, const cConfig_callbacks *, void *);
+
+extern unsigned int cConfig_parse_fd(int, const cConfig_callbacks *, void *);
+
+extern unsigned int cConfig_parse_buffer(const char *, size_t, const cConfig_callbacks *, void *);
+
+extern unsigned int cConfig_load_lazy(const char *);
+
+extern unsigned int cConfig_compile(const char *, const char *);
+
+extern unsigned int cConfig_load_snapshot(const char *, const char *);
+
+extern unsigned int cConfig_publish_shm(const char *);
+
+extern unsigned int cConfig_attach_shm(const char *);
+
+extern unsigned int cConfig_freeze(void);
+
+extern unsigned int cConfig_watch(const char *, cConfig_watch_fn, void *);
+
+extern void cConfig_unwatch(void);
+
+extern unsigned int cConfig_get_stats(cConfig_stats *);
+
+extern unsigned int cConfig_profile_dump(FILE *);
+
 extern cConfig_opt *cConfig_get_opt(const char *);
 
 extern void cConfig_free(void);
 
+extern unsigned int cConfig_load_many(const char **, size_t, int, cConfig_load_status *);
+
+extern unsigned int cConfig_reload(const char *);
+
+extern void cConfig_read_lock(void);
+
+extern void cConfig_read_unlock(void);
+
 extern unsigned int cConfig_find_opt_value(char *, char *);
 
+extern unsigned int cConfig_find_opt_value_n(const char *, const char *, size_t);
+
 extern char *cConfig_get_value(const char *);
 
+extern cConfig_key_t cConfig_resolve(const char *);
+
+extern cConfig_opt *cConfig_get_opt_by_key(cConfig_key_t);
+
+extern char *cConfig_get_value_by_key(cConfig_key_t);
+
+extern void cConfig_free_key(cConfig_key_t);
+
 extern void cConfig_print_opt(char *);
 
+extern unsigned int cConfig_get_int(const char *, int64_t *);
+
+extern unsigned int cConfig_get_double(const char *, double *);
+
+extern unsigned int cConfig_get_bool(const char *, unsigned int *);
+
+extern unsigned int cConfig_get_bytes(const char *, uint64_t *);
+
+extern unsigned int cConfig_get_duration(const char *, int64_t *);
+
+extern int64_t *cConfig_get_int_array(const char *, size_t *);
+
+extern double *cConfig_get_double_array(const char *, size_t *);
+
+extern cConfig_ctx *cConfig_ctx_new(void);
+
+extern void cConfig_ctx_free(cConfig_ctx *);
+
+extern unsigned int cConfig_ctx_load(cConfig_ctx *, const char *);
+
+extern unsigned int cConfig_ctx_load_mmap(cConfig_ctx *, const char *);
+
+extern unsigned int cConfig_ctx_load_buffer(cConfig_ctx *, const char *, size_t);
+
+extern unsigned int cConfig_ctx_load_fd(cConfig_ctx *, int);
+
+extern unsigned int cConfig_ctx_load_parallel(cConfig_ctx *, const char *, int);
+
+extern unsigned int cConfig_ctx_load_filtered(cConfig_ctx *, const char *, const char **, size_t);
+
+extern unsigned int cConfig_ctx_parse_stream(cConfig_ctx *, FILE *, const cConfig_callbacks *, void *);
+
+extern unsigned int cConfig_ctx_parse_fd(cConfig_ctx *, int, const cConfig_callbacks *, void *);
+
+extern unsigned int cConfig_ctx_parse_buffer(cConfig_ctx *, const char *, size_t,
+                                             const cConfig_callbacks *, void *);
+
+extern unsigned int cConfig_ctx_load_lazy(cConfig_ctx *, const char *);
+
+extern unsigned int cConfig_ctx_compile(cConfig_ctx *, const char *, const char *);
+
+extern unsigned int cConfig_ctx_load_snapshot(cConfig_ctx *, const char *, const char *);
+
+extern unsigned int cConfig_ctx_publish_shm(cConfig_ctx *, const char *);
+
+extern unsigned int cConfig_ctx_attach_shm(cConfig_ctx *, const char *);
+
+extern unsigned int cConfig_ctx_freeze(cConfig_ctx *);
+
+extern unsigned int cConfig_ctx_watch(cConfig_ctx *, const char *, cConfig_watch_fn, void *);
+
+extern void cConfig_ctx_unwatch(cConfig_ctx *);
+
+extern unsigned int cConfig_ctx_get_stats(cConfig_ctx *, cConfig_stats *);
+
+extern unsigned int cConfig_ctx_reload(cConfig_ctx *, const char *);
+
+extern unsigned int cConfig_ctx_load_many(cConfig_ctx *, const char **, size_t, int,
+                                          cConfig_load_status *);
+
+extern cConfig_opt *cConfig_ctx_get_opt(cConfig_ctx *, const char *);
+
+extern char *cConfig_ctx_get_value(cConfig_ctx *, const char *);
+
+extern unsigned int cConfig_ctx_find_opt_value(cConfig_ctx *, char *, char *);
+
+extern unsigned int cConfig_ctx_find_opt_value_n(cConfig_ctx *, const char *, const char *, size_t);
+
+extern cConfig_key_t cConfig_ctx_resolve(cConfig_ctx *, const char *);
+
+extern void cConfig_ctx_print_opt(cConfig_ctx *, char *);
+
+extern unsigned int cConfig_ctx_get_int(cConfig_ctx *, const char *, int64_t *);
+
+extern unsigned int cConfig_ctx_get_double(cConfig_ctx *, const char *, double *);
+
+extern unsigned int cConfig_ctx_get_bool(cConfig_ctx *, const char *, unsigned int *);
+
+extern unsigned int cConfig_ctx_get_bytes(cConfig_ctx *, const char *, uint64_t *);
+
+extern unsigned int cConfig_ctx_get_duration(cConfig_ctx *, const char *, int64_t *);
+
+extern int64_t *cConfig_ctx_get_int_array(cConfig_ctx *, const char *, size_t *);
+
+extern double *cConfig_ctx_get_double_array(cConfig_ctx *, const char *, size_t *);
+
 #endif
@@ -0,0 +1,217 @@
+/* 
+ * epoch.c ~ Epoch based reclamation for lock free readers.
+ *
+ * Copyright (c) 2013 "cConfig" Niels Vanden Eynde 
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "lib.h"
+#include "epoch.h"
+
+/* One per thread that ever entered an epoch. Records are never freed,
+   a thread that exits hands its record to the next new thread. */
+struct epoch_reader
+{
+    /* Epoch the thread entered, 0 while it is outside. */
+    unsigned long epoch;
+
+    /* Number of nested epoch_enter calls. */
+    unsigned int depth;
+
+    /* Non zero while a thread owns this record. */
+    int in_use;
+
+#ifdef CCONFIG_STATS
+    /* Lookups by the threads that owned this record, see
+       epoch_count_lookup. Only written by the owner. */
+    unsigned long hits;
+    unsigned long misses;
+#endif
+
+    struct epoch_reader *next;
+};
+
+static unsigned long global_epoch = 1;
+static struct epoch_reader *readers = NULL;
+
+static __thread struct epoch_reader *self = NULL;
+
+static pthread_key_t reader_key;
+static pthread_once_t reader_once = PTHREAD_ONCE_INIT;
+
+/* Called when a thread that has a record exits. */
+static void
+release_reader(void *arg)
+{
+    struct epoch_reader *reader = arg;
+
+    reader->depth = 0;
+    __atomic_store_n(&reader->epoch, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&reader->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void
+make_reader_key(void)
+{
+    pthread_key_create(&reader_key, release_reader);
+}
+
+/* The record of the calling thread, reusing the record of a thread
+   that exited if there is one. */
+static struct epoch_reader *
+get_reader(void)
+{
+    struct epoch_reader *reader;
+    int unused;
+
+    if (self)
+        return self;
+
+    pthread_once(&reader_once, make_reader_key);
+
+    for (reader = __atomic_load_n(&readers, __ATOMIC_ACQUIRE); reader; reader = reader->next)
+    {
+        unused = 0;
+
+        if (__atomic_compare_exchange_n(&reader->in_use, &unused, 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+    }
+
+    if (reader == NULL)
+    {
+        reader = xmalloc(sizeof(struct epoch_reader));
+
+        reader->epoch = 0;
+        reader->depth = 0;
+        reader->in_use = 1;
+#ifdef CCONFIG_STATS
+        reader->hits = 0;
+        reader->misses = 0;
+#endif
+        reader->next = __atomic_load_n(&readers, __ATOMIC_RELAXED);
+
+        while (!__atomic_compare_exchange_n(&readers, &reader->next, reader, 1,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+    }
+
+    pthread_setspecific(reader_key, reader);
+    self = reader;
+
+    return reader;
+}
+
+/* Enter the current epoch, calls nest. Everything a reader loads from
+   shared data after this stays valid until the matching epoch_leave. */
+void
+epoch_enter(void)
+{
+    struct epoch_reader *reader;
+
+    reader = get_reader();
+
+    /* Sequentially consistent, so a writer that advanced the epoch
+       after unlinking something either sees this reader as inside or
+       the reader sees the unlinked pointer replaced. */
+    if (reader->depth++ == 0)
+        __atomic_store_n(&reader->epoch,
+                         __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST),
+                         __ATOMIC_SEQ_CST);
+}
+
+void
+epoch_leave(void)
+{
+    struct epoch_reader *reader = self;
+
+    if (--reader->depth == 0)
+        __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+}
+
+/* Start a new epoch and return it. Readers that enter from now on can't
+   see anything that was unlinked before the call. */
+unsigned long
+epoch_advance(void)
+{
+    return __atomic_add_fetch(&global_epoch, 1, __ATOMIC_SEQ_CST);
+}
+
+/* Non zero once no reader is inside an epoch older than EPOCH. */
+unsigned int
+epoch_passed(unsigned long epoch)
+{
+    struct epoch_reader *reader;
+    unsigned long e;
+
+    for (reader = __atomic_load_n(&readers, __ATOMIC_ACQUIRE); reader; reader = reader->next)
+    {
+        e = __atomic_load_n(&reader->epoch, __ATOMIC_SEQ_CST);
+
+        if (e != 0 && e < epoch)
+            return 0;
+    }
+
+    return 1;
+}
+
+/* Wait for every reader inside an epoch older than EPOCH to leave. */
+void
+epoch_wait(unsigned long epoch)
+{
+    while (!epoch_passed(epoch))
+        sched_yield();
+}
+
+#ifdef CCONFIG_STATS
+/* Count a lookup that found something if FOUND is non zero. Only called
+   inside an epoch, so the thread has a record. */
+void
+epoch_count_lookup(unsigned int found)
+{
+    if (found)
+        __atomic_store_n(&self->hits, self->hits + 1, __ATOMIC_RELAXED);
+    else
+        __atomic_store_n(&self->misses, self->misses + 1, __ATOMIC_RELAXED);
+}
+
+/* Sum the lookups counted by every thread. */
+void
+epoch_lookup_counts(uint64_t *hits, uint64_t *misses)
+{
+    struct epoch_reader *reader;
+
+    *hits = 0;
+    *misses = 0;
+
+    for (reader = __atomic_load_n(&readers, __ATOMIC_ACQUIRE); reader; reader = reader->next)
+    {
+        *hits += __atomic_load_n(&reader->hits, __ATOMIC_RELAXED);
+        *misses += __atomic_load_n(&reader->misses, __ATOMIC_RELAXED);
+    }
+}
+#endif
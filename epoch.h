@@ -0,0 +1,57 @@
+/* 
+ * epoch.h ~ Header file for epoch.c.
+ *
+ * Copyright (c) 2013 "cConfig" Niels Vanden Eynde 
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef CCONFIG_EPOCH_H
+#define CCONFIG_EPOCH_H
+
+#include <stdint.h>
+
+/* Epoch based reclamation. Readers wrap their accesses to shared data
+   in epoch_enter/epoch_leave, which never block. A writer that unlinks
+   something calls epoch_advance and may free it once epoch_passed says
+   no reader entered before that epoch is still inside. */
+
+extern void epoch_enter(void);
+
+extern void epoch_leave(void);
+
+extern unsigned long epoch_advance(void);
+
+extern unsigned int epoch_passed(unsigned long);
+
+extern void epoch_wait(unsigned long);
+
+#ifdef CCONFIG_STATS
+/* Lookups are counted per thread, in the record a thread enters
+   epochs with. */
+
+extern void epoch_count_lookup(unsigned int);
+
+extern void epoch_lookup_counts(uint64_t *, uint64_t *);
+#endif
+
+#endif /* CCONFIG_EPOCH_H */
@@ -0,0 +1,33 @@
+#include <cConfig.h>
+#include <stdio.h>
+
+void
+changed(void *user, const char *name, unsigned int how,
+        const cConfig_opt *old, const cConfig_opt *new)
+{
+    if (how == CCONFIG_REMOVED)
+        printf("%s was removed\n", name);
+    else
+    if (new->is_array)
+        printf("%s is now an array of %d values\n", name, (int)new->size);
+    else
+        printf("%s is now %s\n", name, new->value);
+}
+
+int main(void)
+{
+    cConfig_init();
+
+    if (!cConfig_watch("watch.conf", changed, NULL))
+        return 1;
+
+    printf("name is %s, edit watch.conf or press enter to quit.\n",
+           cConfig_get_value("name"));
+
+    getchar();
+
+    cConfig_unwatch();
+    cConfig_free();
+
+    return 0;
+}
@@ -28,109 +28,214 @@
 #include "lib.h"
 #include "hash.h"
 
-static Hash_node *new_hash_node(const char *, void *);
-static unsigned int hash(const char *);
+/* Buckets moved to the new array per operation while the table grows,
+   and how many empty buckets a single step may skip over. */
+#define REHASH_STEP       4
+#define REHASH_MAX_EMPTY  (REHASH_STEP * 10)
 
-static unsigned int
-hash(const char *string)
+static Hash_node *new_hash_node(const char *, uint64_t, void *, Hash_table *);
+static void rehash_step(Hash_table *, size_t);
+
+/* Bucket for HASHVAL in an array of SIZE buckets, a power of two. */
+#define BUCKET(hashval, size) ((hashval) & ((size) - 1))
+
+/* The hash the table uses for KEY, see find_hash_node_hashed. */
+uint64_t
+hash_key(const char *key)
+{
+    return hash_string(key, strlen(key));
+}
+
+static size_t
+round_size(size_t size)
 {
-    unsigned int hashval = 0;
+    size_t n = 1;
 
-    while (*string)
-        hashval = ((hashval << 5) + hashval) + *string++;
+    while (n < size)
+        n <<= 1;
 
-    return hashval;
+    return n;
 }
 
-/* Initialize the hash table. */
+/* Initialize the hash table, SIZE is rounded up to a power of two. */
 Hash_table *
 new_hash_table(size_t size)
 {
     Hash_table *table;
     
     table = xmalloc(sizeof(Hash_table));
+    size = round_size(size);
 
     table->nodes = xcalloc(size, sizeof(Hash_node *));
     table->size = size;
     table->count = 0;
+    table->old_nodes = NULL;
+    table->old_size = 0;
+    table->rehash_index = 0;
+    table->arena = NULL;
+    table->replaced = NULL;
 
     return table;
 }
 
 static Hash_node *
-new_hash_node(const char *key, void *data)
+new_hash_node(const char *key, uint64_t hashval, void *data, Hash_table *table)
 {
     Hash_node *node;
 
-    node = xmalloc(sizeof(Hash_node));
+    if (table->arena)
+        node = arena_alloc(table->arena, sizeof(Hash_node));
+    else
+        node = xmalloc(sizeof(Hash_node));
 
-    node->key = dupstr(key);
+    node->key = (char *)key;
+    node->hash = hashval;
     node->data = data;
     node->next = NULL;
 
     return node;
 }
 
-void 
-resize_hash_table(const size_t size, Hash_table **table)
+/* Start moving the nodes over to a new array of SIZE buckets. The
+   current buckets are kept as the old ones and emptied a few at a time
+   by rehash_step, lookups check both until that is done. */
+static void
+start_rehash(size_t size, Hash_table *table)
+{
+    table->old_nodes = table->nodes;
+    table->old_size = table->size;
+    table->rehash_index = 0;
+
+    table->nodes = xcalloc(size, sizeof(Hash_node *));
+    table->size = size;
+}
+
+/* Relink the nodes of up to STEPS old buckets into the new ones. */
+static void
+rehash_step(Hash_table *table, size_t steps)
 {
-    Hash_table *new_table, *old_table;
     Hash_node *node, *next;
-    size_t i;
+    size_t i, empty = 0;
+
+    while (steps && table->rehash_index < table->old_size)
+    {
+        i = table->rehash_index++;
 
-    new_table = new_hash_table(size);
-    old_table = *table;
+        if ((node = table->old_nodes[i]) == NULL)
+        {
+            if (++empty == REHASH_MAX_EMPTY)
+                break;
+            continue;
+        }
 
-    for (i = 0; i < old_table->size; ++i)
-        for (node = old_table->nodes[i]; node != NULL; node = next)
+        for (; node != NULL; node = next)
         {
             next = node->next;
-            insert_hash_node(node->key, node->data, new_table);
-            remove_hash_node(node->key, old_table);
+            node->next = table->nodes[BUCKET(node->hash, table->size)];
+            table->nodes[BUCKET(node->hash, table->size)] = node;
         }
 
-    xfree(old_table->nodes);
-    xfree(old_table);
+        table->old_nodes[i] = NULL;
+        steps--;
+    }
 
-    *table = new_table; 
+    if (table->rehash_index == table->old_size)
+    {
+        xfree(table->old_nodes);
+        table->old_nodes = NULL;
+        table->old_size = 0;
+        table->rehash_index = 0;
+    }
+}
+
+/* The bucket for HASHVAL, in whichever array it is now. */
+static Hash_node **
+find_bucket(uint64_t hashval, Hash_table *table)
+{
+    size_t i;
+
+    if (table->old_nodes)
+    {
+        i = BUCKET(hashval, table->old_size);
+
+        if (i >= table->rehash_index)
+            return &table->old_nodes[i];
+    }
+
+    return &table->nodes[BUCKET(hashval, table->size)];
+}
+
+/* Rehash all nodes into SIZE buckets (rounded up to a power of two)
+   right away. Nodes are relinked, not copied, so pointers to them
+   stay valid. */
+void 
+resize_hash_table(const size_t size, Hash_table **table)
+{
+    Hash_table *t = *table;
+
+    finish_rehash(t);
+    start_rehash(round_size(size), t);
+    finish_rehash(t);
+}
+
+/* Move over whatever buckets are left from growing the table, so
+   lookups only have one array to look in. */
+void
+finish_rehash(Hash_table *table)
+{
+    while (table->old_nodes)
+        rehash_step(table, table->old_size);
 }
 
 Hash_node *
 insert_hash_node(const char *key, void *data, Hash_table *table)
 {
-    Hash_node *node;
-    unsigned int hashkey;
+    Hash_node *node, **bucket;
+    uint64_t hashval;
 
-    hashkey = hash(key) % table->size;
+    if (table->old_nodes)
+        rehash_step(table, REHASH_STEP);
+    else if (table->count >= table->size)
+        start_rehash(table->size * 2, table);
 
-    node = table->nodes[hashkey];
+    hashval = hash_key(key);
+    bucket = find_bucket(hashval, table);
 
-    while (node && node->next)
+    /* Replace the data of an existing key. Data in an arena backed
+       table belongs to the arena so it is left to the caller, in
+       REPLACED. */
+    table->replaced = NULL;
+
+    for (node = *bucket; node != NULL; node = node->next)
     {
-        if (streq(node->key, key))
+        if (node->hash == hashval && streq(node->key, key))
         {
-            xfree(node->data);
-            node->data = dupstr(data);
+            if (!table->arena)
+                xfree(node->data);
+            else
+                table->replaced = node->data;
+
+            node->key = (char *)key;
+            node->data = data;
             return node;
         }
-        node = node->next;
     }
     
-    node = new_hash_node(key, data);
-    node->next = table->nodes[hashkey];
+    node = new_hash_node(key, hashval, data, table);
+    node->next = *bucket;
 
     table->count++;
-    table->nodes[hashkey] = node;
+    *bucket = node;
 
     return node;
 }
 
 /* Free a single node, node->data children must free
-   free before calling this function. */
+   free before calling this function. The key is owned
+   by the caller and is left alone. */
 void
 free_hash_node(Hash_node *node)
 {
-    xfree(node->key);
     xfree(node->data);
     xfree(node);
 }
@@ -140,42 +245,40 @@ free_hash_node(Hash_node *node)
 unsigned int
 remove_hash_node(const char *key, Hash_table *table)
 {
-    Hash_node *node, *prev = NULL;
-    unsigned int hashkey;
+    Hash_node *node, **prev;
+    uint64_t hashval;
 
-    hashkey = hash(key) % table->size;
-    node = table->nodes[hashkey];
+    if (table->old_nodes)
+        rehash_step(table, REHASH_STEP);
 
-    while (node)
+    hashval = hash_key(key);
+    prev = find_bucket(hashval, table);
+
+    for (node = *prev; node != NULL; prev = &node->next, node = node->next)
     {
-        if (!streq(node->key, key))
-        {
-            prev = node;
-            node = node->next;
+        if (node->hash != hashval || !streq(node->key, key))
             continue;
-        }
 
-        if (prev)
-            prev->next = node->next;
-        else
-            table->nodes[hashkey] = node->next;
+        *prev = node->next;
+
+        if (!table->arena)
+            free_hash_node(node);
 
-        free_hash_node(node);
+        table->count--;
         return 1;
     }
     return 0;
 }
 
-/* Free the entire hash table. */
-void
-free_hash_table(Hash_table *table)
+static void
+free_hash_nodes(Hash_node **nodes, size_t size)
 {
     size_t i;
     Hash_node *node, *prev;
 
-    for (i = 0; i < table->size; ++i)
+    for (i = 0; i < size; ++i)
     {
-        node = table->nodes[i];
+        node = nodes[i];
         while (node)
         {
             prev = node;
@@ -183,29 +286,93 @@ free_hash_table(Hash_table *table)
             free_hash_node(prev);
         }
     }
+}
+
+/* Free the entire hash table. */
+void
+free_hash_table(Hash_table *table)
+{
+    if (!table->arena)
+    {
+        free_hash_nodes(table->nodes, table->size);
+
+        if (table->old_nodes)
+            free_hash_nodes(table->old_nodes, table->old_size);
+    }
 
     xfree(table->nodes);
+    xfree(table->old_nodes);
     xfree(table);
 }
 
+/* Call FN with every node in the table. The table must not change
+   until it returns. */
+void
+walk_hash_table(Hash_table *table, void (*fn)(Hash_node *, void *), void *arg)
+{
+    Hash_node *node;
+    size_t i;
+
+    for (i = 0; i < table->size; ++i)
+        for (node = table->nodes[i]; node != NULL; node = node->next)
+            fn(node, arg);
+
+    if (table->old_nodes)
+        for (i = table->rehash_index; i < table->old_size; ++i)
+            for (node = table->old_nodes[i]; node != NULL; node = node->next)
+                fn(node, arg);
+}
+
+/* Count the buckets of TABLE by length in HIST, which has N entries.
+   HIST[i] is the number of buckets with i nodes, HIST[N - 1] also
+   counts the longer ones. */
+void
+hash_table_chains(Hash_table *table, size_t *hist, size_t n)
+{
+    Hash_node *node;
+    size_t i, len;
+
+    for (i = 0; i < table->size; ++i)
+    {
+        for (len = 0, node = table->nodes[i]; node != NULL; node = node->next)
+            len++;
+
+        hist[len < n ? len : n - 1]++;
+    }
+
+    if (table->old_nodes)
+        for (i = table->rehash_index; i < table->old_size; ++i)
+        {
+            for (len = 0, node = table->old_nodes[i]; node != NULL; node = node->next)
+                len++;
+
+            hist[len < n ? len : n - 1]++;
+        }
+}
+
 /* Find a node in the hash table identified by KEY. */
 Hash_node *
 find_hash_node(const char *key, Hash_table *table)
 {
-    unsigned int hashkey;
-    Hash_node *node;
+    return find_hash_node_hashed(key, hash_key(key), table);
+}
 
-    hashkey = hash(key) % table->size;
+/* Same as find_hash_node, for a KEY already hashed by hash_key. */
+Hash_node *
+find_hash_node_hashed(const char *key, uint64_t hashval, Hash_table *table)
+{
+    Hash_node *node;
 
-    node = table->nodes[hashkey];
+    node = *find_bucket(hashval, table);
 
+    /* Compare the cached hashes first, most nodes in the chain
+       can be skipped without touching their key. */
     while (node)
     {
-        if (streq(node->key, key))
+        if (node->hash == hashval && streq(node->key, key))
             return node;
         else
             node = node->next;
     }
     return NULL;
 }
-
@@ -29,16 +29,69 @@
 #define CCONFIG_HASH_H
 
 #include <string.h>
+#include <stdint.h>
 #include "lib.h"
 
+#ifdef CCONFIG_OPEN_HASH
+
+/* Open addressing (Robin Hood) table, see hash_open.c. Nodes are
+   stored inline in the table so a node returned by find_hash_node
+   or insert_hash_node only stays valid until the table changes. */
+struct hash_node
+{
+    /* Hash of the key, 0 marks an empty slot. */
+    uint64_t hash;
+
+    /* First bytes of the key, compared before following KEY. */
+    unsigned int prefix;
+
+    /* Key to find a node, this is not copied so it has to
+       live at least as long as the node. */
+    char *key;
+
+    /* The data we need. */
+    void *data;
+};
+
+typedef struct hash_node Hash_node;
+
+struct hash_table
+{
+    /* Number of slots, always a power of two. */
+    size_t size;
+
+    /* Number of nodes in the hash table. */
+    size_t count;
+
+    /* The slots of the hash table. */
+    Hash_node *nodes;
+
+    /* Nodes always live in the table itself, but if this is not
+       NULL the data belongs to the arena and is never freed. */
+    Arena *arena;
+
+    /* Data the last insert_hash_node replaced in a table with an
+       arena, NULL if it added a node. */
+    void *replaced;
+};
+
+typedef struct hash_table Hash_table;
+
+#else
+
 struct hash_node
 {
-    /* Key to find a node. */
+    /* Key to find a node, this is not copied so it has to
+       live at least as long as the node. */
     char *key;
 
     /* The data we need. */
     void *data;
 
+    /* Full hash of the key, compared before the key itself and
+       used to move the node without hashing the key again. */
+    uint64_t hash;
+
     /* Next hash in the table. */
     struct hash_node *next;
 };
@@ -47,7 +100,7 @@ typedef struct hash_node Hash_node;
 
 struct hash_table
 {
-    /* Number of allocated nodes. */
+    /* Number of buckets, always a power of two. */
     size_t size;
 
     /* Number of nodes in the hash table. */
@@ -55,16 +108,44 @@ struct hash_table
 
     /* The hash nodes in the hash table. */
     Hash_node **nodes;
+
+    /* Once COUNT reaches SIZE the table grows: NODES is replaced by
+       an array twice as large and the old buckets are moved over a
+       few at a time by every insert and removal. Until then OLD_NODES
+       holds the buckets at REHASH_INDEX and up. Lookups look in
+       whichever array a bucket is in and never move any, so several
+       threads can read the table at once. The price is that a table
+       that stops growing halfway keeps both arrays, and lookups the
+       extra check, until finish_rehash; cConfig calls it once per
+       load rather than after every insert. */
+    Hash_node **old_nodes;
+    size_t old_size;
+    size_t rehash_index;
+
+    /* If not NULL nodes are allocated from here and are only
+       released when the arena is. */
+    Arena *arena;
+
+    /* Data the last insert_hash_node replaced in a table with an
+       arena, NULL if it added a node. */
+    void *replaced;
 };
 
 typedef struct hash_table Hash_table;
 
+#endif /* CCONFIG_OPEN_HASH */
+
 extern Hash_table *new_hash_table(size_t);
 extern Hash_node *insert_hash_node(const char *, void *, Hash_table *);
 extern void free_hash_node(Hash_node *);
 extern unsigned int remove_hash_node(const char *, Hash_table *);
 extern void free_hash_table(Hash_table *);
 extern Hash_node *find_hash_node(const char *, Hash_table *);
+extern Hash_node *find_hash_node_hashed(const char *, uint64_t, Hash_table *);
+extern uint64_t hash_key(const char *);
 extern void resize_hash_table(const size_t, Hash_table **);
+extern void finish_rehash(Hash_table *);
+extern void walk_hash_table(Hash_table *, void (*)(Hash_node *, void *), void *);
+extern void hash_table_chains(Hash_table *, size_t *, size_t);
 
 #endif /* CCCONFIG_HASH_H */
@@ -0,0 +1,342 @@
+/* 
+ * hash_open.c - Open addressing hash table.
+ *
+ * Copyright (c) 2012 "cConfig" Niels Vanden Eynde 
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "lib.h"
+#include "hash.h"
+
+/* Smallest table and the number of nodes a table of SIZE slots
+   holds before it grows, 7/8 of its slots. */
+#define MIN_SIZE 8
+#define MAX_LOAD(size) ((size) - (size) / 8)
+
+static unsigned int key_prefix(const char *);
+static Hash_node *place_node(Hash_node, Hash_table *);
+static Hash_node *lookup(const char *, uint64_t, Hash_table *);
+
+/* The hash the table uses for KEY, see find_hash_node_hashed.
+   Never 0, since that marks an empty slot. */
+uint64_t
+hash_key(const char *key)
+{
+    uint64_t hashval;
+
+    hashval = hash_string(key, strlen(key));
+
+    return hashval ? hashval : 1;
+}
+
+/* The first bytes of KEY packed into an int. */
+static unsigned int
+key_prefix(const char *key)
+{
+    unsigned int prefix = 0;
+    size_t i;
+
+    for (i = 0; i < sizeof(prefix) && key[i]; ++i)
+        prefix |= (unsigned int)(unsigned char)key[i] << (i * 8);
+
+    return prefix;
+}
+
+static size_t
+round_size(size_t size)
+{
+    size_t n = MIN_SIZE;
+
+    while (n < size)
+        n <<= 1;
+
+    return n;
+}
+
+/* Initialize the hash table. */
+Hash_table *
+new_hash_table(size_t size)
+{
+    Hash_table *table;
+
+    table = xmalloc(sizeof(Hash_table));
+
+    table->size = round_size(size);
+    table->nodes = xcalloc(table->size, sizeof(Hash_node));
+    table->count = 0;
+    table->arena = NULL;
+    table->replaced = NULL;
+
+    return table;
+}
+
+/* Distance of the node in slot I from the slot its hash picks. */
+#define PROBE_DISTANCE(i, hashval, mask) (((i) - (hashval)) & (mask))
+
+/* Put NODE, which isn't in TABLE yet, into the first free slot along
+   its probe sequence. On the way it takes the slot of any node that is
+   closer to its own home slot and carries that one along instead, which
+   keeps probe sequences short. Returns the slot NODE ended up in. */
+static Hash_node *
+place_node(Hash_node node, Hash_table *table)
+{
+    Hash_node *slot, *placed = NULL, temp;
+    size_t mask, i, dist, d;
+
+    mask = table->size - 1;
+    dist = 0;
+
+    for (i = node.hash & mask; ; i = (i + 1) & mask, ++dist)
+    {
+        slot = &table->nodes[i];
+
+        if (slot->hash == 0)
+        {
+            *slot = node;
+            return placed ? placed : slot;
+        }
+
+        d = PROBE_DISTANCE(i, slot->hash, mask);
+
+        if (d < dist)
+        {
+            temp = *slot;
+            *slot = node;
+            node = temp;
+
+            if (!placed)
+                placed = slot;
+
+            dist = d;
+        }
+    }
+}
+
+/* Move every node into a new array of SIZE slots. */
+static void
+grow_hash_table(size_t size, Hash_table *table)
+{
+    Hash_node *nodes;
+    size_t i, old_size;
+
+    nodes = table->nodes;
+    old_size = table->size;
+
+    table->nodes = xcalloc(size, sizeof(Hash_node));
+    table->size = size;
+
+    for (i = 0; i < old_size; ++i)
+        if (nodes[i].hash)
+            place_node(nodes[i], table);
+
+    xfree(nodes);
+}
+
+void 
+resize_hash_table(const size_t size, Hash_table **table)
+{
+    size_t n;
+
+    n = round_size(size);
+
+    while (MAX_LOAD(n) < (*table)->count)
+        n <<= 1;
+
+    grow_hash_table(n, *table);
+}
+
+/* The table grows all at once, so there is never anything to finish.
+   Lookups never modify the table. */
+void
+finish_rehash(Hash_table *table)
+{
+}
+
+static Hash_node *
+lookup(const char *key, uint64_t hashval, Hash_table *table)
+{
+    Hash_node *node;
+    unsigned int prefix;
+    size_t mask, i, dist;
+
+    prefix = key_prefix(key);
+    mask = table->size - 1;
+    dist = 0;
+
+    /* A slot further from its home than we are from ours means KEY
+       would have taken it, so KEY isn't in the table. */
+    for (i = hashval & mask; ; i = (i + 1) & mask, ++dist)
+    {
+        node = &table->nodes[i];
+
+        if (node->hash == 0 || PROBE_DISTANCE(i, node->hash, mask) < dist)
+            return NULL;
+
+        if (node->hash == hashval && node->prefix == prefix && streq(node->key, key))
+            return node;
+    }
+}
+
+Hash_node *
+insert_hash_node(const char *key, void *data, Hash_table *table)
+{
+    Hash_node node, *found;
+    uint64_t hashval;
+
+    hashval = hash_key(key);
+    table->replaced = NULL;
+
+    /* Data in an arena backed table belongs to the arena, it is left
+       to the caller in REPLACED. */
+    if ((found = lookup(key, hashval, table)) != NULL)
+    {
+        if (!table->arena)
+            xfree(found->data);
+        else
+            table->replaced = found->data;
+
+        found->key = (char *)key;
+        found->data = data;
+        return found;
+    }
+
+    if (table->count + 1 > MAX_LOAD(table->size))
+        grow_hash_table(table->size * 2, table);
+
+    node.hash = hashval;
+    node.prefix = key_prefix(key);
+    node.key = (char *)key;
+    node.data = data;
+
+    table->count++;
+
+    return place_node(node, table);
+}
+
+/* Free the data of a single node, the node itself is part of the
+   table. The key is owned by the caller and is left alone. */
+void
+free_hash_node(Hash_node *node)
+{
+    xfree(node->data);
+}
+
+/* Remove an item from the hashtable specified by 'key'. If no item
+   is found, return 0. Otherwise return 1. */
+unsigned int
+remove_hash_node(const char *key, Hash_table *table)
+{
+    Hash_node *node, *next;
+    size_t mask, i;
+
+    if ((node = lookup(key, hash_key(key), table)) == NULL)
+        return 0;
+
+    if (!table->arena)
+        free_hash_node(node);
+
+    mask = table->size - 1;
+    i = node - table->nodes;
+
+    /* Shift the following nodes back a slot until one that is empty
+       or already in its home slot, instead of leaving a tombstone. */
+    for (;;)
+    {
+        next = &table->nodes[(i + 1) & mask];
+
+        if (next->hash == 0 || PROBE_DISTANCE((i + 1) & mask, next->hash, mask) == 0)
+            break;
+
+        table->nodes[i] = *next;
+        i = (i + 1) & mask;
+    }
+
+    memset(&table->nodes[i], 0, sizeof(Hash_node));
+    table->count--;
+
+    return 1;
+}
+
+/* Free the entire hash table. */
+void
+free_hash_table(Hash_table *table)
+{
+    size_t i;
+
+    for (i = 0; i < table->size && !table->arena; ++i)
+        if (table->nodes[i].hash)
+            free_hash_node(&table->nodes[i]);
+
+    xfree(table->nodes);
+    xfree(table);
+}
+
+/* Call FN with every node in the table. The table must not change
+   until it returns. */
+void
+walk_hash_table(Hash_table *table, void (*fn)(Hash_node *, void *), void *arg)
+{
+    size_t i;
+
+    for (i = 0; i < table->size; ++i)
+        if (table->nodes[i].hash)
+            fn(&table->nodes[i], arg);
+}
+
+/* Count the nodes of TABLE by the number of slots a lookup probes to
+   find them in HIST, which has N entries. HIST[0] is the number of
+   empty slots, HIST[N - 1] also counts the nodes further away. */
+void
+hash_table_chains(Hash_table *table, size_t *hist, size_t n)
+{
+    size_t i, len, mask;
+
+    mask = table->size - 1;
+
+    for (i = 0; i < table->size; ++i)
+    {
+        if (table->nodes[i].hash == 0)
+        {
+            hist[0]++;
+            continue;
+        }
+
+        len = PROBE_DISTANCE(i, table->nodes[i].hash, mask) + 1;
+        hist[len < n ? len : n - 1]++;
+    }
+}
+
+/* Find a node in the hash table identified by KEY. */
+Hash_node *
+find_hash_node(const char *key, Hash_table *table)
+{
+    return lookup(key, hash_key(key), table);
+}
+
+/* Same as find_hash_node, for a KEY already hashed by hash_key. */
+Hash_node *
+find_hash_node_hashed(const char *key, uint64_t hashval, Hash_table *table)
+{
+    return lookup(key, hashval, table);
+}
@@ -28,9 +28,36 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <ctype.h>
+#include <math.h>
+#include <malloc.h>
 
 #include "lib.h"
 
+/* Bytes asked for and number of calls to xmalloc, xcalloc and
+   xrealloc, see alloc_stats. A realloc only adds what the block grew
+   by, so buffers that double aren't counted over and over. */
+static uint64_t alloc_bytes = 0;
+static uint64_t alloc_calls = 0;
+
+static void
+count_alloc(size_t size)
+{
+    __atomic_add_fetch(&alloc_bytes, size, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&alloc_calls, 1, __ATOMIC_RELAXED);
+}
+
+/* Store the bytes asked for and the number of allocations made so far,
+   memory that was freed included. */
+void
+alloc_stats(uint64_t *bytes, uint64_t *calls)
+{
+    *bytes = __atomic_load_n(&alloc_bytes, __ATOMIC_RELAXED);
+    *calls = __atomic_load_n(&alloc_calls, __ATOMIC_RELAXED);
+}
+
 void *
 xmalloc(const size_t size)
 {
@@ -38,10 +65,12 @@ xmalloc(const size_t size)
   
     if (ptr == NULL)    
     {
-        fprintf (stderr, "fatal: memory exhausted (malloc of %d bytes).\n", size);
+        fprintf (stderr, "fatal: memory exhausted (malloc of %zu bytes).\n", size);
         exit (EXIT_FAILURE);
     }
 
+    count_alloc(size);
+
     return ptr;
 }
 
@@ -52,25 +81,30 @@ xcalloc(const size_t count, const size_t size)
 
     if (!(ptr = calloc(count, size)))
     {
-        fprintf(stderr, "fatal: memory exhausted (xmalloc of %d bytes).\n", size);
+        fprintf(stderr, "fatal: memory exhausted (calloc of %zu bytes).\n", count * size);
         exit(EXIT_FAILURE);
     }
 
+    count_alloc(count * size);
+
     return ptr;
 }
 
 void *
 xrealloc(void *p, const size_t size)
 {
+    size_t old = malloc_usable_size(p);
     void *ptr = realloc(p, size);
 
     if (ptr == NULL)
     {
         free(p);
-        fprintf (stderr, "fatal: memory exhausted (realloc of %d bytes).\n", size);
+        fprintf (stderr, "fatal: memory exhausted (realloc of %zu bytes).\n", size);
         exit (EXIT_FAILURE);
     }
 
+    count_alloc(size > old ? size - old : 0);
+
     return ptr;
 }
 
@@ -111,10 +145,17 @@ duparr(char **array, size_t size)
     return dup;
 }
 
+/* Split SRC at the characters in TOKENS into *LIST, skipping empty
+   elements the way strtok does, but without its hidden state so it is
+   safe to use from several threads. The pointers and the strings they
+   point to are a single allocation, released by passing *LIST to xfree.
+   Returns 0 if SRC has no elements. */
 unsigned int
 explode(const char *src, const char *tokens, char ***list, size_t *len)
 {   
-    char *str, *copy, **_list = NULL;
+    const char *str;
+    char **_list, *out;
+    size_t n, count = 0, bytes = 0;
 
     if (src == NULL || list == NULL || len == NULL)
         return 0;
@@ -122,40 +163,435 @@ explode(const char *src, const char *tokens, char ***list, size_t *len)
     *list = NULL;
     *len  = 0;
 
-    copy = dupstr(src);
+    for (str = src + strspn(src, tokens); *str != '\0'; str += strspn(str, tokens))
+    {
+        n = strcspn(str, tokens);
+        bytes += n + 1;
+        count++;
+        str += n;
+    }
 
-    str = strtok(copy, tokens);
+    if (count == 0)
+        return 0;
+
+    _list = xmalloc(count * sizeof(*_list) + bytes);
+    out = (char *)(_list + count);
 
-    if (str == NULL)
+    for (str = src + strspn(src, tokens); *str != '\0'; str += strspn(str, tokens))
     {
-        xfree(copy);
+        n = strcspn(str, tokens);
+
+        memcpy(out, str, n);
+        out[n] = '\0';
+
+        _list[(*len)++] = out;
+        out += n + 1;
+        str += n;
+    }
+
+    *list = _list;
+
+    return 1;
+}
+
+unsigned int
+streq(const char *string1, const char *string2) 
+{
+    return (*string1 == *string2 && strcmp(string1, string2) == 0);
+}
+
+
+/* Parse all of STRING as a (decimal, hex or octal) integer. */
+unsigned int
+parse_int(const char *string, int64_t *value)
+{
+    char *end;
+    long long n;
+
+    errno = 0;
+    n = strtoll(string, &end, 0);
+
+    if (end == string || *end != '\0' || errno == ERANGE)
         return 0;
+
+    *value = n;
+    return 1;
+}
+
+/* Parse all of STRING as a floating point number. */
+unsigned int
+parse_double(const char *string, double *value)
+{
+    char *end;
+    double d;
+
+    errno = 0;
+    d = strtod(string, &end);
+
+    if (end == string || *end != '\0' || errno == ERANGE)
+        return 0;
+
+    *value = d;
+    return 1;
+}
+
+/* Parse true/false, yes/no, on/off or 1/0, ignoring case. */
+unsigned int
+parse_bool(const char *string, unsigned int *value)
+{
+    static const char *words[] = { "true", "yes", "on", "1", 
+                                   "false", "no", "off", "0" };
+    size_t i;
+
+    for (i = 0; i < sizeof(words) / sizeof(*words); ++i)
+    {
+        if (strcasecmp(string, words[i]) == 0)
+        {
+            *value = i < 4;
+            return 1;
+        }
     }
 
-    _list = xmalloc(sizeof(*_list));
+    return 0;
+}
+
+/* Parse a size such as "512", "64K", "1.5GB" or "2MiB". Suffixes are
+   powers of 1024 and ignore case. */
+unsigned int
+parse_bytes(const char *string, uint64_t *value)
+{
+    static const char units[] = "BKMGTPE";
+    const char *unit;
+    char *end;
+    double d, scale;
+
+    /* strtod skips leading white space, the sign is after it. */
+    while (isspace((unsigned char)*string))
+        string++;
 
-    _list[*len] = dupstr(str);
+    if (*string == '-')
+        return 0;
 
-    (*len)++;
+    errno = 0;
+    d = strtod(string, &end);
 
-    while((str = strtok(NULL, tokens)) != NULL)
-    {   
-        _list = xrealloc(_list, (*len + 1) * sizeof(*_list));
+    if (end == string || errno == ERANGE || !isfinite(d))
+        return 0;
 
-        _list[*len] = dupstr(str);
+    scale = 1;
 
-        (*len)++;
+    if (*end != '\0')
+    {
+        if ((unit = strchr(units, toupper((unsigned char)*end))) == NULL)
+            return 0;
+
+        scale = (double)(1ULL << (10 * (unit - units)));
+        end++;
+
+        if (unit != units && (*end == 'i' || *end == 'I'))
+            end++;
+
+        if (unit != units && (*end == 'b' || *end == 'B'))
+            end++;
+
+        if (*end != '\0')
+            return 0;
     }
 
-    *list = _list;
-    xfree(copy);
+    d *= scale;
 
+    if (d >= 18446744073709551616.0)
+        return 0;
+
+    *value = (uint64_t)d;
     return 1;
 }
 
+/* Parse a duration such as "250ms", "1.5s" or "1h30m" into nanoseconds.
+   Units are ns, us, ms, s, m, h and d, only "0" may leave it out. */
 unsigned int
-streq(const char *string1, const char *string2) 
+parse_duration(const char *string, int64_t *value)
 {
-    return (*string1 == *string2 && strcmp(string1, string2) == 0);
+    static const struct { const char *unit; double ns; } units[] = {
+        { "ns", 1 }, { "us", 1e3 }, { "ms", 1e6 }, { "s", 1e9 },
+        { "m", 60e9 }, { "h", 3600e9 }, { "d", 86400e9 } };
+    const char *p;
+    char *end;
+    double d, total = 0;
+    size_t i, len;
+    int sign = 1;
+
+    p = string;
+
+    if (*p == '-' || *p == '+')
+        sign = *p++ == '-' ? -1 : 1;
+
+    if (strcmp(p, "0") == 0)
+    {
+        *value = 0;
+        return 1;
+    }
+
+    if (*p == '\0')
+        return 0;
+
+    while (*p)
+    {
+        if (*p == '-' || *p == '+')
+            return 0;
+
+        errno = 0;
+        d = strtod(p, &end);
+
+        if (end == p || errno == ERANGE || !isfinite(d))
+            return 0;
+
+        for (len = 0; end[len] && isalpha((unsigned char)end[len]); ++len)
+            ;
+
+        for (i = 0; i < sizeof(units) / sizeof(*units); ++i)
+            if (strlen(units[i].unit) == len && strncmp(end, units[i].unit, len) == 0)
+                break;
+
+        if (i == sizeof(units) / sizeof(*units))
+            return 0;
+
+        total += d * units[i].ns;
+        p = end + len;
+    }
+
+    if (total >= 9223372036854775808.0)
+        return 0;
+
+    *value = sign * (int64_t)total;
+    return 1;
 }
 
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+#if CCONFIG_HASH_FN != HASH_FN_DJB2
+
+/* Final mix of murmur3, every input bit affects every output bit. */
+static uint64_t
+mix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+#endif
+
+#if CCONFIG_HASH_FN == HASH_FN_WORD
+
+/* Mix in the string 8 bytes at a time the way the body of murmur3 does,
+   the tail is zero padded into one last word. */
+uint64_t
+hash_string(const char *string, size_t len)
+{
+    uint64_t hashval, word;
+    size_t n = len;
+
+    hashval = 0x9e3779b97f4a7c15ULL;
+
+    for (; n >= 8; n -= 8, string += 8)
+    {
+        memcpy(&word, string, 8);
+
+        word *= 0x87c37b91114253d5ULL;
+        word = ROTL64(word, 31);
+        word *= 0x4cf5ad432745937fULL;
+
+        hashval ^= word;
+        hashval = ROTL64(hashval, 27) * 5 + 0x52dce729;
+    }
+
+    if (n)
+    {
+        word = 0;
+        memcpy(&word, string, n);
+
+        word *= 0x87c37b91114253d5ULL;
+        word = ROTL64(word, 31);
+        word *= 0x4cf5ad432745937fULL;
+
+        hashval ^= word;
+    }
+
+    return mix64(hashval ^ len);
+}
+
+#elif CCONFIG_HASH_FN == HASH_FN_FNV1A
+
+uint64_t
+hash_string(const char *string, size_t len)
+{
+    uint64_t hashval = 0xcbf29ce484222325ULL;
+
+    while (len--)
+        hashval = (hashval ^ (unsigned char)*string++) * 0x100000001b3ULL;
+
+    return mix64(hashval);
+}
+
+#elif CCONFIG_HASH_FN == HASH_FN_DJB2
+
+/* The original hash, only here to compare against. */
+uint64_t
+hash_string(const char *string, size_t len)
+{
+    uint64_t hashval = 0;
+
+    while (len--)
+        hashval = ((hashval << 5) + hashval) + *string++;
+
+    return hashval;
+}
+
+#else
+#error "unknown CCONFIG_HASH_FN"
+#endif
+
+#define ARENA_ALIGN     (2 * sizeof(void *))
+#define ARENA_MAX_CHUNK (1024 * 1024)
+
+/* Create an arena whose first chunk holds SIZE bytes. */
+Arena *
+new_arena(size_t size)
+{
+    Arena *arena;
+
+    arena = xmalloc(sizeof(Arena));
+
+    arena->chunks = NULL;
+    arena->chunk_size = size;
+
+    return arena;
+}
+
+/* Add a chunk of at least SIZE bytes to the front of ARENA. */
+static struct arena_chunk *
+new_arena_chunk(Arena *arena, size_t size)
+{
+    struct arena_chunk *chunk;
+
+    if (size < arena->chunk_size)
+        size = arena->chunk_size;
+
+    chunk = xmalloc(sizeof(struct arena_chunk) + size);
+
+    chunk->size = size;
+    chunk->used = 0;
+
+    /* A chunk made for one oversized allocation goes behind the
+       current one so the space left there isn't wasted. */
+    if (size > arena->chunk_size && arena->chunks)
+    {
+        chunk->next = arena->chunks->next;
+        arena->chunks->next = chunk;
+        return chunk;
+    }
+
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+
+    if (arena->chunk_size < ARENA_MAX_CHUNK)
+        arena->chunk_size *= 2;
+
+    return chunk;
+}
+
+static void *
+arena_bump(Arena *arena, size_t size, size_t align)
+{
+    struct arena_chunk *chunk;
+    size_t used;
+
+    chunk = arena->chunks;
+
+    if (chunk)
+    {
+        used = (chunk->used + align - 1) & ~(align - 1);
+
+        if (used + size <= chunk->size)
+        {
+            chunk->used = used + size;
+            return chunk->data + used;
+        }
+    }
+
+    chunk = new_arena_chunk(arena, size);
+    chunk->used = size;
+
+    return chunk->data;
+}
+
+/* Allocate SIZE bytes from ARENA, suitably aligned for any type. */
+void *
+arena_alloc(Arena *arena, size_t size)
+{
+    return arena_bump(arena, size, ARENA_ALIGN);
+}
+
+/* Copy the first LEN bytes of STRING into ARENA and NUL terminate it. */
+char *
+arena_dupstrn(Arena *arena, const char *string, size_t len)
+{
+    char *dup;
+
+    dup = arena_bump(arena, len + 1, 1);
+    memcpy(dup, string, len);
+    dup[len] = '\0';
+
+    return dup;
+}
+
+char *
+arena_dupstr(Arena *arena, const char *string)
+{
+    return arena_dupstrn(arena, string, strlen(string));
+}
+
+/* Move every chunk of SRC into DST and free SRC. What was allocated
+   from SRC is released with DST from then on. */
+void
+arena_merge(Arena *dst, Arena *src)
+{
+    struct arena_chunk *chunk, *last;
+
+    if ((chunk = src->chunks) != NULL)
+    {
+        for (last = chunk; last->next != NULL; last = last->next)
+            ;
+
+        /* Keep allocating from the current chunk of DST. */
+        if (dst->chunks)
+        {
+            last->next = dst->chunks->next;
+            dst->chunks->next = chunk;
+        }
+        else
+            dst->chunks = chunk;
+    }
+
+    xfree(src);
+}
+
+/* Release every chunk in ARENA and ARENA itself. */
+void
+free_arena(Arena *arena)
+{
+    struct arena_chunk *chunk, *next;
+
+    for (chunk = arena->chunks; chunk != NULL; chunk = next)
+    {
+        next = chunk->next;
+        xfree(chunk);
+    }
+
+    xfree(arena);
+}
@@ -31,13 +31,28 @@
 #define CCONFIG_LIB_H
 
 #include <stdlib.h>
+#include <stdint.h>
+
+/* Functions hash_string can be built with, pick one with
+   -DCCONFIG_HASH_FN=HASH_FN_..., the default is HASH_FN_WORD. */
+#define HASH_FN_WORD   1
+#define HASH_FN_FNV1A  2
+#define HASH_FN_DJB2   3
+
+#ifndef CCONFIG_HASH_FN
+#define CCONFIG_HASH_FN HASH_FN_WORD
+#endif
 
 extern void *xmalloc(size_t);
 
 extern void xfree(void * );
 
+extern void alloc_stats(uint64_t *, uint64_t *);
+
 extern void *xcalloc(const size_t , const size_t );
 
+extern void *xrealloc(void *, const size_t );
+
 extern char *dupstr(const char * );
 
 extern unsigned int streq(const char *, const char *); 
@@ -46,4 +61,57 @@ extern unsigned int explode(const char *, const char *, char ***, size_t *);
 
 extern char **duparr(char **, size_t );
 
+extern uint64_t hash_string(const char *, size_t);
+
+extern unsigned int parse_int(const char *, int64_t *);
+
+extern unsigned int parse_double(const char *, double *);
+
+extern unsigned int parse_bool(const char *, unsigned int *);
+
+extern unsigned int parse_bytes(const char *, uint64_t *);
+
+extern unsigned int parse_duration(const char *, int64_t *);
+
+/* A chunk of memory handed out by an arena. */
+struct arena_chunk
+{
+    /* Next (older) chunk. */
+    struct arena_chunk *next;
+
+    /* Bytes available and bytes handed out in DATA. */
+    size_t size;
+    size_t used;
+
+    /* Rounds the header up to four pointers so DATA, and with it
+       every arena_alloc, is aligned to ARENA_ALIGN. */
+    size_t pad;
+
+    char data[];
+};
+
+/* Bump allocator, memory is only released all at once by free_arena. */
+struct arena
+{
+    /* The chunk allocations are made from, older chunks follow. */
+    struct arena_chunk *chunks;
+
+    /* Size of the next chunk, doubles up to ARENA_MAX_CHUNK. */
+    size_t chunk_size;
+};
+
+typedef struct arena Arena;
+
+extern Arena *new_arena(size_t);
+
+extern void *arena_alloc(Arena *, size_t);
+
+extern char *arena_dupstr(Arena *, const char *);
+
+extern char *arena_dupstrn(Arena *, const char *, size_t);
+
+extern void arena_merge(Arena *, Arena *);
+
+extern void free_arena(Arena *);
+
 #endif /* CCONFIG_LIB_H */
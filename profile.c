@@ -0,0 +1,301 @@
+/* 
+ * profile.c ~ Latency histograms of library calls, built with PROFILE=1.
+ *
+ * Copyright (c) 2013 "cConfig" Niels Vanden Eynde 
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lib.h"
+#include "profile.h"
+
+/* Latencies are kept in HDR style buckets: exact below PROFILE_SUB
+   nanoseconds, above that every power of two is split in PROFILE_SUB
+   buckets, so a bucket is within 1/PROFILE_SUB of what it holds.
+   Anything from 2^PROFILE_MAX_BITS on (about 18 minutes) goes in the
+   last bucket. */
+#define PROFILE_SUB_BITS 4
+#define PROFILE_SUB      (1 << PROFILE_SUB_BITS)
+#define PROFILE_MAX_BITS 40
+#define PROFILE_BUCKETS  ((PROFILE_MAX_BITS - PROFILE_SUB_BITS + 1) * PROFILE_SUB)
+
+/* Names of the points, as dumped. */
+static const char *point_names[PROFILE_POINTS] =
+{
+    "load", "parse_line", "get_opt", "find_opt_value", "free"
+};
+
+/* One per thread that ever recorded a call. Records are never freed,
+   a thread that exits hands its record, and what it recorded, to the
+   next new thread. Only the owner writes the histograms, with relaxed
+   stores so profile_dump can read them at any time. */
+struct profile_thread
+{
+    /* When the current call of every point started. */
+    uint64_t started[PROFILE_POINTS];
+
+    uint64_t counts[PROFILE_POINTS][PROFILE_BUCKETS];
+    uint64_t total_ns[PROFILE_POINTS];
+    uint64_t max_ns[PROFILE_POINTS];
+
+    /* Non zero while a thread owns this record. */
+    int in_use;
+
+    struct profile_thread *next;
+};
+
+static struct profile_thread *threads = NULL;
+
+static __thread struct profile_thread *self = NULL;
+
+static pthread_key_t thread_key;
+static pthread_once_t thread_once = PTHREAD_ONCE_INIT;
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Called when a thread that has a record exits. */
+static void
+release_thread(void *arg)
+{
+    struct profile_thread *t = arg;
+
+    __atomic_store_n(&t->in_use, 0, __ATOMIC_RELEASE);
+}
+
+/* Dump to the file named by CCONFIG_PROFILE_FILE in the environment,
+   or to stderr, when the process exits. */
+static void
+dump_at_exit(void)
+{
+    const char *path;
+    FILE *f;
+
+    if ((path = getenv("CCONFIG_PROFILE_FILE")) == NULL || *path == '\0')
+    {
+        profile_dump(stderr);
+        return;
+    }
+
+    if ((f = fopen(path, "w")) == NULL)
+    {
+        perror(path);
+        return;
+    }
+
+    profile_dump(f);
+    fclose(f);
+}
+
+static void
+init_profile(void)
+{
+    pthread_key_create(&thread_key, release_thread);
+    atexit(dump_at_exit);
+}
+
+/* The record of the calling thread, see get_reader in epoch.c. */
+static struct profile_thread *
+get_thread(void)
+{
+    struct profile_thread *t;
+    int unused;
+
+    if (self)
+        return self;
+
+    pthread_once(&thread_once, init_profile);
+
+    for (t = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); t; t = t->next)
+    {
+        unused = 0;
+
+        if (__atomic_compare_exchange_n(&t->in_use, &unused, 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+    }
+
+    if (t == NULL)
+    {
+        t = xmalloc(sizeof(struct profile_thread));
+        memset(t, 0, sizeof(struct profile_thread));
+
+        t->in_use = 1;
+        t->next = __atomic_load_n(&threads, __ATOMIC_RELAXED);
+
+        while (!__atomic_compare_exchange_n(&threads, &t->next, t, 1,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+    }
+
+    pthread_setspecific(thread_key, t);
+    self = t;
+
+    return t;
+}
+
+static size_t
+bucket_of(uint64_t ns)
+{
+    unsigned int bits;
+
+    if (ns < PROFILE_SUB)
+        return ns;
+
+    bits = 63 - __builtin_clzll(ns);
+
+    if (bits >= PROFILE_MAX_BITS)
+        return PROFILE_BUCKETS - 1;
+
+    return (bits - PROFILE_SUB_BITS + 1) * PROFILE_SUB
+           + ((ns >> (bits - PROFILE_SUB_BITS)) & (PROFILE_SUB - 1));
+}
+
+/* Largest latency that goes in BUCKET. */
+static uint64_t
+bucket_max(size_t bucket)
+{
+    unsigned int shift;
+
+    if (bucket < PROFILE_SUB)
+        return bucket;
+
+    shift = bucket / PROFILE_SUB - 1;
+
+    return ((uint64_t)(PROFILE_SUB + bucket % PROFILE_SUB + 1) << shift) - 1;
+}
+
+void
+profile_start(unsigned int point)
+{
+    get_thread()->started[point] = now_ns();
+}
+
+/* Record the call of POINT the calling thread started last. */
+void
+profile_end(unsigned int point)
+{
+    struct profile_thread *t = self;
+    uint64_t ns, *count;
+
+    if (t == NULL || t->started[point] == 0)
+        return;
+
+    ns = now_ns() - t->started[point];
+    t->started[point] = 0;
+
+    count = &t->counts[point][bucket_of(ns)];
+
+    __atomic_store_n(count, *count + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&t->total_ns[point], t->total_ns[point] + ns, __ATOMIC_RELAXED);
+
+    if (ns > t->max_ns[point])
+        __atomic_store_n(&t->max_ns[point], ns, __ATOMIC_RELAXED);
+}
+
+/* Smallest bucket maximum that at least P of the CALLS in COUNTS are
+   under, or MAX if that is less. */
+static uint64_t
+percentile(const uint64_t *counts, uint64_t calls, uint64_t max, double p)
+{
+    uint64_t seen = 0, rank;
+    size_t i;
+
+    rank = (uint64_t)(p * calls + 0.5);
+
+    if (rank == 0)
+        rank = 1;
+
+    for (i = 0; i < PROFILE_BUCKETS; ++i)
+        if ((seen += counts[i]) >= rank)
+            return bucket_max(i) < max ? bucket_max(i) : max;
+
+    return max;
+}
+
+/* Write one line per point to F, merging the histograms of every
+   thread:
+
+     point=get_opt calls=... mean_ns=... p50_ns=... p90_ns=...
+     p99_ns=... p999_ns=... max_ns=...
+
+   Percentiles are the top of their bucket, HDR style. */
+void
+profile_dump(FILE *f)
+{
+    struct profile_thread *t;
+    uint64_t counts[PROFILE_BUCKETS], calls, total, max, n;
+    unsigned int point;
+    size_t i;
+
+    for (point = 0; point < PROFILE_POINTS; ++point)
+    {
+        memset(counts, 0, sizeof(counts));
+        calls = total = max = 0;
+
+        for (t = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); t; t = t->next)
+        {
+            for (i = 0; i < PROFILE_BUCKETS; ++i)
+            {
+                n = __atomic_load_n(&t->counts[point][i], __ATOMIC_RELAXED);
+                counts[i] += n;
+                calls += n;
+            }
+
+            total += __atomic_load_n(&t->total_ns[point], __ATOMIC_RELAXED);
+
+            if ((n = __atomic_load_n(&t->max_ns[point], __ATOMIC_RELAXED)) > max)
+                max = n;
+        }
+
+        if (calls == 0)
+        {
+            fprintf(f, "point=%s calls=0\n", point_names[point]);
+            continue;
+        }
+
+        fprintf(f, "point=%s calls=%llu mean_ns=%llu p50_ns=%llu p90_ns=%llu "
+                "p99_ns=%llu p999_ns=%llu max_ns=%llu\n", point_names[point],
+                (unsigned long long)calls, (unsigned long long)(total / calls),
+                (unsigned long long)percentile(counts, calls, max, 0.50),
+                (unsigned long long)percentile(counts, calls, max, 0.90),
+                (unsigned long long)percentile(counts, calls, max, 0.99),
+                (unsigned long long)percentile(counts, calls, max, 0.999),
+                (unsigned long long)max);
+    }
+
+    fflush(f);
+}
@@ -0,0 +1,60 @@
+/* 
+ * profile.h ~ Header file for profile.c.
+ *
+ * Copyright (c) 2013 "cConfig" Niels Vanden Eynde 
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef CCONFIG_PROFILE_H
+#define CCONFIG_PROFILE_H
+
+#include <stdio.h>
+
+/* Calls whose latency is recorded by a library built with PROFILE=1.
+   PROFILE_LOAD is every function that loads a table. */
+#define PROFILE_LOAD           0
+#define PROFILE_PARSE_LINE     1
+#define PROFILE_GET_OPT        2
+#define PROFILE_FIND_OPT_VALUE 3
+#define PROFILE_FREE           4
+#define PROFILE_POINTS         5
+
+/* PROFILE_START(point) and PROFILE_END(point) go around a call, they
+   compile to nothing without CCONFIG_PROFILE. A point is only timed
+   once at a time per thread, a return between the two records nothing. */
+#ifdef CCONFIG_PROFILE
+#define PROFILE_START(point) profile_start(point)
+#define PROFILE_END(point)   profile_end(point)
+
+extern void profile_start(unsigned int);
+
+extern void profile_end(unsigned int);
+
+/* Write the latencies recorded by every thread to F. */
+extern void profile_dump(FILE *);
+#else
+#define PROFILE_START(point)
+#define PROFILE_END(point)
+#endif
+
+#endif /* CCONFIG_PROFILE_H */
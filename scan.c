@@ -0,0 +1,186 @@
+/* 
+ * scan.c ~ Finding the characters parse_line has to look at.
+ *
+ * Copyright (c) 2013 "cConfig" Niels Vanden Eynde 
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "scan.h"
+
+#ifdef CCONFIG_SCAN_X86
+#include <immintrin.h>
+#endif
+
+#define SPECIAL(c, delim) \
+    ((unsigned char)(c) <= ' ' || (c) == '"' || (c) == '(' || (c) == ')' || (c) == (delim))
+
+typedef const char *(*scan_fn)(const char *, const char *, char);
+
+const char *
+scan_line_scalar(const char *string, const char *end, char delim)
+{
+    while (string < end && !SPECIAL(*string, delim))
+        string++;
+
+    return string;
+}
+
+#ifdef CCONFIG_SCAN_X86
+
+/* Mask of the bytes in X that SPECIAL would match. Bytes up to a space
+   are found by comparing X to its minimum with a space. */
+#define SPECIAL_MASK_SSE2(x, space, quote, open, close, delim)          \
+    _mm_movemask_epi8(                                                  \
+        _mm_or_si128(                                                   \
+            _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(x, space), x),     \
+                         _mm_cmpeq_epi8(x, quote)),                     \
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, open),          \
+                                      _mm_cmpeq_epi8(x, close)),        \
+                         _mm_cmpeq_epi8(x, delim))))
+
+const char *
+scan_line_sse2(const char *string, const char *end, char delim)
+{
+    __m128i x, space, quote, open, close, d;
+    unsigned int mask;
+
+    space = _mm_set1_epi8(' ');
+    quote = _mm_set1_epi8('"');
+    open = _mm_set1_epi8('(');
+    close = _mm_set1_epi8(')');
+    d = _mm_set1_epi8(delim);
+
+    /* Never load past END, the buffer might end at a page boundary. */
+    while (end - string >= 16)
+    {
+        x = _mm_loadu_si128((const __m128i *)string);
+
+        if ((mask = SPECIAL_MASK_SSE2(x, space, quote, open, close, d)) != 0)
+            return string + __builtin_ctz(mask);
+
+        string += 16;
+    }
+
+    return scan_line_scalar(string, end, delim);
+}
+
+__attribute__((target("avx2")))
+const char *
+scan_line_avx2(const char *string, const char *end, char delim)
+{
+    __m256i x, space, quote, open, close, d, m;
+    unsigned int mask;
+
+    space = _mm256_set1_epi8(' ');
+    quote = _mm256_set1_epi8('"');
+    open = _mm256_set1_epi8('(');
+    close = _mm256_set1_epi8(')');
+    d = _mm256_set1_epi8(delim);
+
+    while (end - string >= 32)
+    {
+        x = _mm256_loadu_si256((const __m256i *)string);
+
+        m = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(x, space), x),
+                                _mm256_cmpeq_epi8(x, quote)),
+                _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(x, open),
+                                                _mm256_cmpeq_epi8(x, close)),
+                                _mm256_cmpeq_epi8(x, d)));
+
+        if ((mask = _mm256_movemask_epi8(m)) != 0)
+            return string + __builtin_ctz(mask);
+
+        string += 32;
+    }
+
+    return scan_line_sse2(string, end, delim);
+}
+
+unsigned int
+scan_have_avx2(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+}
+
+#endif /* CCONFIG_SCAN_X86 */
+
+static const char *pick_scan(const char *, const char *, char);
+
+static scan_fn scan_impl = pick_scan;
+static const char *scan_name = NULL;
+
+/* Replace itself by the version to use on the first call. */
+static const char *
+pick_scan(const char *string, const char *end, char delim)
+{
+    const char *env;
+    scan_fn fn;
+    const char *name;
+
+    env = getenv("CCONFIG_SCAN");
+
+    fn = scan_line_scalar;
+    name = "scalar";
+
+#ifdef CCONFIG_SCAN_X86
+    if (env == NULL || strcmp(env, "scalar") != 0)
+    {
+        fn = scan_line_sse2;
+        name = "sse2";
+
+        if ((env == NULL || strcmp(env, "sse2") != 0) && scan_have_avx2())
+        {
+            fn = scan_line_avx2;
+            name = "avx2";
+        }
+    }
+#else
+    (void)env;
+#endif
+
+    /* Racing threads all pick the same version. */
+    __atomic_store_n(&scan_name, name, __ATOMIC_RELAXED);
+    __atomic_store_n(&scan_impl, fn, __ATOMIC_RELAXED);
+
+    return fn(string, end, delim);
+}
+
+const char *
+scan_line(const char *string, const char *end, char delim)
+{
+    return __atomic_load_n(&scan_impl, __ATOMIC_RELAXED)(string, end, delim);
+}
+
+const char *
+scan_line_name(void)
+{
+    if (__atomic_load_n(&scan_name, __ATOMIC_RELAXED) == NULL)
+        scan_line("", "", '=');
+
+    return scan_name;
+}
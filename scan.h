@@ -0,0 +1,57 @@
+/* 
+ * scan.h ~ Finding the characters parse_line has to look at.
+ *
+ * Copyright (c) 2013 "cConfig" Niels Vanden Eynde 
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef CCONFIG_SCAN_H
+#define CCONFIG_SCAN_H
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define CCONFIG_SCAN_X86
+#endif
+
+/* Return the first character between STRING and END that might mean
+   something to parse_line: a quote, parenthesis, DELIM, or anything up
+   to and including a space, which covers newlines and NUL. Everything
+   before it can be copied as it is. Returns END if there is none.
+
+   scan_line uses the fastest version the CPU supports, which can be
+   overridden with CCONFIG_SCAN=scalar, sse2 or avx2 in the environment. */
+extern const char *scan_line(const char *, const char *, char);
+
+extern const char *scan_line_scalar(const char *, const char *, char);
+
+#ifdef CCONFIG_SCAN_X86
+extern const char *scan_line_sse2(const char *, const char *, char);
+
+extern const char *scan_line_avx2(const char *, const char *, char);
+
+extern unsigned int scan_have_avx2(void);
+#endif
+
+/* Name of the version scan_line uses. */
+extern const char *scan_line_name(void);
+
+#endif /* CCONFIG_SCAN_H */
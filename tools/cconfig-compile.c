@@ -0,0 +1,20 @@
+#include <cConfig.h>
+#include <stdio.h>
+
+/* Compile a configuration file into a snapshot for cConfig_load_snapshot. */
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s SOURCE SNAPSHOT\n", argv[0]);
+        return 1;
+    }
+
+    if (!cConfig_compile(argv[1], argv[2]))
+    {
+        fprintf(stderr, "%s: could not compile %s to %s\n", argv[0], argv[1], argv[2]);
+        return 1;
+    }
+
+    return 0;
+}